@@ -0,0 +1,34 @@
+/* helpers shared by the benchmarks. every benchmark prints CSV rows:
+
+   benchmark,param,usec
+
+   ...where usec is the median of several runs; bench.py adds the scheduler
+   and thread count and collects the rows into bin/bench.csv and bin/bench.json. */
+#include <chrono>
+#include <vector>
+#include <algorithm>
+#include <stdio.h>
+
+inline double bench_usec() {
+    using namespace std::chrono;
+    return duration_cast<duration<double, std::micro> >(steady_clock::now().time_since_epoch()).count();
+}
+
+/* the median time of reps runs of f(), divided by per (the number of operations f does) */
+template<class F>
+double bench_median(int reps, int per, const F& f) {
+    std::vector<double> times;
+    f(); /* warm up */
+    for(int r=0; r<reps; ++r) {
+        double start = bench_usec();
+        f();
+        times.push_back((bench_usec() - start) / per);
+    }
+    std::sort(times.begin(), times.end());
+    return times[times.size()/2];
+}
+
+inline void bench_row(const char* benchmark, int param, double usec) {
+    printf("%s,%d,%.4f\n", benchmark, param, usec);
+    fflush(stdout);
+}
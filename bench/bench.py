@@ -0,0 +1,141 @@
+#!/usr/bin/python
+'''runtime overhead benchmarks, run under every enabled parallel scheduler (and serial, as a baseline):
+
+* overhead: empty ct_for(n) latency, per-index overhead vs grain size, ctx_invoke spawn cost,
+  and fork/join latency at nesting depths 1 to 16.
+* scaling: a fixed workload at $CT_THREADS=1..N (strong scaling.)
+* submit: 1, 4, 16 and 64 threads submitting small loops at once - the wall time per loop
+  over all the submitters (inverse throughput), and the loops' median and 99th percentile latency.
+* spin: back-to-back small loops separated by serial phases of 0 to 1000 usec, under pthreads
+  with several $CT_SPIN_USEC settings - the latency of each loop, and the CPU time it costs.
+* shuffle: under shuffle (and pshuffle), the time from ct_for(n) to its first index for n
+  up to 2^30, and the cost per index of a loop run in the permuted order.
+* latency: under pthreads, the median and 99th percentile latency of small loops issued while
+  batch loops keep the pool busy, as normal-priority (param 0) and high-priority (param 1) loops.
+
+results go to bin/bench.csv and bin/bench.json, one row per (scheduler, threads, spin, benchmark, param).
+spin is the $CT_SPIN_USEC setting, and is only set for the spin benchmark.
+'''
+import os
+import sys
+import json
+import commands
+sys.path.insert(0, os.path.join(os.path.dirname(sys.argv[0]), '..'))
+import build
+
+if 'C++11' not in build.enabled:
+    print 'the benchmarks need C++11 - not building them'
+    sys.exit(0)
+
+verbose = build.verbose
+
+print '\nbuilding benchmarks'
+
+benchmarks = 'overhead.cpp scaling.cpp submit.cpp spin.cpp shuffle.cpp latency.cpp'.split()
+built = [build.buildtest(b,dir='bench') for b in benchmarks]
+
+scheds = [s for s in 'serial openmp tbb pthreads'.split() if s == 'serial' or s in [f.lower() for f in build.enabled]]
+nprocs = os.sysconf('SC_NPROCESSORS_ONLN')
+
+spin_settings = '0 20 200 adaptive'.split()
+shuffle_scheds = ['shuffle'] + (['pshuffle'] if 'pthreads' in scheds else [])
+
+columns = 'sched threads spin benchmark param usec'.split()
+rows = []
+
+def run(name,sched,threads,spin=''):
+    # OpenMP doesn't look at $CT_THREADS
+    command = 'env CT_SCHED=%s CT_THREADS=%d OMP_NUM_THREADS=%d CT_SPIN_USEC=%s ./bin/%s'%(sched,threads,threads,spin or 0,name)
+    if verbose:
+        print ' ','running',command
+    status,output = commands.getstatusoutput(command)
+    if status != 0:
+        print ' ',command,'FAILED'
+        print output
+        sys.exit(1)
+    for line in output.split('\n'):
+        benchmark,param,usec = line.split(',')
+        rows.append(dict(sched=sched,threads=threads,spin=spin,benchmark=benchmark,param=int(param),usec=float(usec)))
+        if verbose>1:
+            print '   ',line
+
+print '\nrunning benchmarks'
+
+thread_counts = sorted(set([1,nprocs] + [t for t in [2,4,8,16,32,64,128] if t < nprocs]))
+for sched in scheds:
+    print ' ',sched
+    run('overhead',sched,nprocs)
+    run('submit',sched,nprocs)
+    for threads in thread_counts if sched != 'serial' else [1]:
+        run('scaling',sched,threads)
+if 'pthreads' in scheds:
+    for spin in spin_settings:
+        run('spin','pthreads',nprocs,spin)
+    run('latency','pthreads',nprocs)
+for sched in shuffle_scheds:
+    run('shuffle',sched,nprocs)
+
+csv = open('bin/bench.csv','w')
+csv.write(','.join(columns)+'\n')
+for row in rows:
+    csv.write(','.join([str(row[c]) for c in columns])+'\n')
+csv.close()
+json.dump(rows,open('bin/bench.json','w'),indent=1)
+
+# a human-readable summary: one column per scheduler
+print
+print '%-16s'%'benchmark'+''.join(['%12s'%s for s in scheds])
+keys = []
+for row in rows:
+    if row['spin'] or row['sched'] in shuffle_scheds or row['benchmark'].startswith('prio'):
+        continue
+    key = (row['benchmark'],row['param'],row['threads'] if row['benchmark'] == 'scaling' else None)
+    if key not in keys:
+        keys.append(key)
+for benchmark,param,threads in keys:
+    label = '%s(%d)'%(benchmark,threads if threads else param)
+    values = []
+    for sched in scheds:
+        match = [r['usec'] for r in rows if r['sched'] == sched and r['benchmark'] == benchmark and r['param'] == param \
+                 and (threads is None or r['threads'] == threads)]
+        values.append('%12.4f'%match[0] if match else '%12s'%'-')
+    print '%-16s'%label+''.join(values)
+print '\n(usec; grain rows are per unit of work, submit_loop is per loop over all submitters, the rest per call.)'
+
+spin_rows = [r for r in rows if r['spin']]
+if spin_rows:
+    print
+    print '%-16s'%'pthreads spin'+''.join(['%12s'%s for s in spin_settings])
+    for benchmark in 'b2b_latency b2b_cpu'.split():
+        for param in sorted(set([r['param'] for r in spin_rows])):
+            values = []
+            for spin in spin_settings:
+                match = [r['usec'] for r in spin_rows if r['spin'] == spin and r['benchmark'] == benchmark and r['param'] == param]
+                values.append('%12.4f'%match[0] if match else '%12s'%'-')
+            print '%-16s'%('%s(%d)'%(benchmark,param))+''.join(values)
+    print '\n(usec per loop; the parameter is the serial phase between loops. b2b_cpu is summed over all threads.)'
+
+shuffle_rows = [r for r in rows if r['sched'] in shuffle_scheds]
+print
+print '%-24s'%'shuffle'+''.join(['%12s'%s for s in shuffle_scheds])
+for benchmark,param in sorted(set([(r['benchmark'],r['param']) for r in shuffle_rows])):
+    values = []
+    for sched in shuffle_scheds:
+        match = [r['usec'] for r in shuffle_rows if r['sched'] == sched and r['benchmark'] == benchmark and r['param'] == param]
+        values.append('%12.4f'%match[0] if match else '%12s'%'-')
+    print '%-24s'%('%s(%d)'%(benchmark,param))+''.join(values)
+print '\n(usec; shuffle_start is the time to the first index of ct_for(n), shuffle_index is per index.)'
+
+prio_rows = [r for r in rows if r['benchmark'].startswith('prio')]
+if prio_rows:
+    print
+    print '%-16s'%'pthreads prio'+''.join(['%12s'%p for p in 'normal high'.split()])
+    for benchmark in 'prio_p50 prio_p99'.split():
+        values = []
+        for param in [0,1]:
+            match = [r['usec'] for r in prio_rows if r['benchmark'] == benchmark and r['param'] == param]
+            values.append('%12.4f'%match[0] if match else '%12s'%'-')
+        print '%-16s'%benchmark+''.join(values)
+    print '\n(usec per small loop, issued while batch loops keep the pool busy.)'
+
+print '\nwrote bin/bench.csv and bin/bench.json'
@@ -0,0 +1,50 @@
+/* the latency of small loops issued while batch loops keep the pool busy, as
+   normal-priority and as high-priority loops (param 0 and 1): with priorities,
+   a small loop should wait for an index of a batch loop rather than for the
+   batch loops queued before it. the batch submitters are application threads
+   running big loops back to back; the timed loops are issued from the main
+   thread, one at a time, and have enough indexes for their latency to depend on
+   how soon the workers join in. only pthreads has priority classes. */
+#include "checkedthreads.h"
+#include "bench.h"
+#include <thread>
+#include <atomic>
+
+inline void work(int units) {
+    volatile int sink = 0;
+    for(int u=0; u<units; ++u) {
+        sink = sink + u;
+    }
+}
+
+int main() {
+    const int batch_submitters = 4;
+    const int small_loops = 200;
+    ct_init(0);
+    std::atomic<bool> stop(false);
+    std::vector<std::thread> threads;
+    for(int s=0; s<batch_submitters; ++s) {
+        threads.push_back(std::thread([&] {
+            while(!stop) {
+                ctx_for(256, [](int) { work(20000); });
+            }
+        }));
+    }
+    for(int priority=CT_PRIO_NORMAL; priority<=CT_PRIO_HIGH; ++priority) {
+        std::vector<double> times;
+        for(int l=0; l<small_loops; ++l) {
+            double start = bench_usec();
+            ctx_for(32, [](int) { work(2000); }, 0, priority);
+            times.push_back(bench_usec() - start);
+        }
+        std::sort(times.begin(), times.end());
+        bench_row("prio_p50", priority, times[times.size()/2]);
+        bench_row("prio_p99", priority, times[times.size()*99/100]);
+    }
+    stop = true;
+    for(size_t t=0; t<threads.size(); ++t) {
+        threads[t].join();
+    }
+    ct_fini();
+    return 0;
+}
@@ -0,0 +1,34 @@
+/* many short ctx_for loops with short serial phases between them, for measuring
+   the Valgrind tool's cost of switching between instrumented and uninstrumented
+   code (--serial-threshold-ms, --instrument-serial): every loop scales a small
+   array, and the serial code between loops sums it up. */
+#include "checkedthreads.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N 256
+
+int g_data[N];
+
+int main(int argc, char** argv) {
+    int loops = argc > 1 ? atoi(argv[1]) : 1000;
+    int serial = argc > 2 ? atoi(argv[2]) : 16; /* passes over the array between loops */
+    long sum = 0;
+    for(int i=0; i<N; ++i) {
+        g_data[i] = i;
+    }
+    ct_init(0);
+    for(int l=0; l<loops; ++l) {
+        ctx_for(N, [=](int i) {
+            g_data[i] = (g_data[i] * 3 + l) & 0xffff;
+        });
+        for(int s=0; s<serial; ++s) {
+            for(int i=0; i<N; ++i) {
+                sum += g_data[i] ^ s;
+            }
+        }
+    }
+    ct_fini();
+    printf("%ld\n", sum);
+    return 0;
+}
@@ -0,0 +1,43 @@
+/* nested ctx_invoke to a given depth, for measuring the Valgrind tool's per-level
+   cost: every level splits its half of an array in two, and the leaves write
+   their part of it, reading a table written before the loops. */
+#include "checkedthreads.h"
+#include <stdio.h>
+#include <stdlib.h>
+
+#define N (1024*1024)
+#define TABLE 4096
+
+int g_data[N];
+int g_table[TABLE];
+
+void split(int depth, int start, int end) {
+    if(depth == 0) {
+        for(int i=start; i<end; ++i) {
+            g_data[i] = g_table[i % TABLE] + 1;
+        }
+        return;
+    }
+    int mid = (start + end) / 2;
+    ctx_invoke(
+        [=] { split(depth-1, start, mid); },
+        [=] { split(depth-1, mid, end); }
+    );
+}
+
+int main(int argc, char** argv) {
+    int depth = argc > 1 ? atoi(argv[1]) : 8;
+    for(int i=0; i<TABLE; ++i) {
+        g_table[i] = i;
+    }
+    ct_init(0);
+    split(depth, 0, N);
+    ct_fini();
+    for(int i=0; i<N; ++i) {
+        if(g_data[i] != i % TABLE + 1) {
+            printf("error at %d!\n", i);
+            return 1;
+        }
+    }
+    return 0;
+}
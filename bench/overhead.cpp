@@ -0,0 +1,60 @@
+/* the runtime's own overhead: loops and invokes doing (next to) no work. */
+#include "checkedthreads.h"
+#include "bench.h"
+
+void empty_index(int, void*) {}
+
+/* units of work the compiler can't optimize away (and which don't share
+   a cache line with other threads' work) */
+inline void work(int units) {
+    volatile int sink = 0;
+    for(int u=0; u<units; ++u) {
+        sink = sink + u;
+    }
+}
+
+/* a chain of depth nested loops of 2 indexes; index 0 goes deeper */
+void nest(int depth) {
+    if(depth == 0) {
+        return;
+    }
+    ctx_for(2, [=](int i) {
+        if(i == 0) {
+            nest(depth-1);
+        }
+    });
+}
+
+int main() {
+    ct_init(0);
+
+    /* the latency of an empty ct_for(n) */
+    for(int n=1; n<=4096; n*=4) {
+        bench_row("empty_for", n, bench_median(101, 1, [=] { ct_for(n, empty_index, 0, 0); }));
+    }
+
+    /* the overhead per index as a function of grain size: the same total work,
+       split into indexes of grain units each. reported per unit of work, so that
+       the serial row is the baseline the rest should approach. */
+    const int total = 1<<20;
+    bench_row("grain_serial", 1, bench_median(11, total, [=] { work(total); }));
+    for(int grain=1; grain<=16384; grain*=4) {
+        bench_row("grain", grain, bench_median(11, total, [=] {
+            ctx_for(total/grain, [=](int) { work(grain); });
+        }));
+    }
+
+    /* the cost of spawning k empty tasks with ctx_invoke */
+    auto nop = [] {};
+    bench_row("invoke", 2, bench_median(101, 1, [=] { ctx_invoke(nop, nop); }));
+    bench_row("invoke", 4, bench_median(101, 1, [=] { ctx_invoke(nop, nop, nop, nop); }));
+    bench_row("invoke", 8, bench_median(101, 1, [=] { ctx_invoke(nop, nop, nop, nop, nop, nop, nop, nop); }));
+
+    /* fork/join latency at nesting depths 1 to 16 */
+    for(int depth=1; depth<=16; ++depth) {
+        bench_row("nest", depth, bench_median(101, 1, [=] { nest(depth); }));
+    }
+
+    ct_fini();
+    return 0;
+}
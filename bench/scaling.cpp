@@ -0,0 +1,21 @@
+/* strong scaling: a fixed amount of work; bench.py runs this with
+   $CT_THREADS=1..N, and lists the time for each thread count in its
+   summary table, as scaling(threads), and in bin/bench.csv. */
+#include "checkedthreads.h"
+#include "bench.h"
+
+int main() {
+    const int n = 4096;
+    const int units = 4096;
+    ct_init(0);
+    bench_row("scaling", n, bench_median(11, 1, [=] {
+        ctx_for(n, [=](int) {
+            volatile int sink = 0;
+            for(int u=0; u<units; ++u) {
+                sink = sink + u;
+            }
+        });
+    }));
+    ct_fini();
+    return 0;
+}
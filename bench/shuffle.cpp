@@ -0,0 +1,28 @@
+/* the order-randomizing schedulers' cost of starting a loop, against n: the time
+   from calling ct_for to running the first index (the loop is cancelled there.)
+   bench.py runs this under shuffle (and pshuffle, if available.) also, the cost
+   per index of running a whole loop of empty indexes in the permuted order. */
+#include "checkedthreads.h"
+#include "bench.h"
+
+void cancel_at_once(int, void* context) {
+    ct_cancel((ct_canceller*)context);
+}
+
+void empty_index(int, void*) {}
+
+int main() {
+    ct_init(0);
+    for(int bits=10; bits<=30; bits+=4) {
+        const int n = 1<<bits;
+        bench_row("shuffle_start", n, bench_median(11, 1, [=] {
+            ct_canceller* c = ct_alloc_canceller();
+            ct_for(n, cancel_at_once, c, c);
+            ct_free_canceller(c);
+        }));
+    }
+    const int n = 1<<20;
+    bench_row("shuffle_index", n, bench_median(11, n, [=] { ct_for(n, empty_index, 0, 0); }));
+    ct_fini();
+    return 0;
+}
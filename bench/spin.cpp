@@ -0,0 +1,43 @@
+/* back-to-back small loops, as in a time-step simulation: a short serial
+   phase on the main thread, then a small parallel loop, over and over.
+   bench.py runs this under pthreads with several $CT_SPIN_USEC settings;
+   parking right away makes every loop pay for waking the workers up, while
+   spinning makes them burn CPU time between the loops. */
+#include "checkedthreads.h"
+#include "bench.h"
+#include <time.h>
+
+inline void work(int units) {
+    volatile int sink = 0;
+    for(int u=0; u<units; ++u) {
+        sink = sink + u;
+    }
+}
+
+inline void serial_phase(double usec) {
+    double start = bench_usec();
+    while(bench_usec() - start < usec);
+}
+
+int main() {
+    const int steps = 500;
+    ct_init(0);
+    for(int gap=0; gap<=1000; gap = gap ? gap*10 : 10) {
+        /* the latency of each loop... */
+        std::vector<double> times;
+        clock_t cpu = clock();
+        for(int s=0; s<steps; ++s) {
+            serial_phase(gap);
+            double start = bench_usec();
+            ctx_for(64, [](int) { work(256); });
+            times.push_back(bench_usec() - start);
+        }
+        cpu = clock() - cpu;
+        std::sort(times.begin(), times.end());
+        bench_row("b2b_latency", gap, times[times.size()/2]);
+        /* ...and the CPU time of all threads per step, including the serial phase */
+        bench_row("b2b_cpu", gap, double(cpu) * 1e6 / CLOCKS_PER_SEC / steps);
+    }
+    ct_fini();
+    return 0;
+}
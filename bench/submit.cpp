@@ -0,0 +1,48 @@
+/* many application threads submitting small loops at once, as in a server
+   calling ct_for from its request threads: throughput (reported as the wall
+   time per loop over all the submitters), and the latency of the loops. */
+#include "checkedthreads.h"
+#include "bench.h"
+#include <thread>
+
+inline void work(int units) {
+    volatile int sink = 0;
+    for(int u=0; u<units; ++u) {
+        sink = sink + u;
+    }
+}
+
+int main() {
+    const int loops_per_submitter = 32;
+    ct_init(0);
+    for(int submitters=1; submitters<=64; submitters*=4) {
+        std::vector<std::vector<double> > times(submitters);
+        std::vector<std::thread> threads;
+        double start = bench_usec();
+        for(int s=0; s<submitters; ++s) {
+            std::vector<double>* mine = &times[s];
+            threads.push_back(std::thread([=] {
+                for(int l=0; l<loops_per_submitter; ++l) {
+                    double loop_start = bench_usec();
+                    ctx_for(16, [](int) { work(2000); });
+                    mine->push_back(bench_usec() - loop_start);
+                }
+            }));
+        }
+        for(size_t t=0; t<threads.size(); ++t) {
+            threads[t].join();
+        }
+        double total = bench_usec() - start;
+
+        std::vector<double> all;
+        for(int s=0; s<submitters; ++s) {
+            all.insert(all.end(), times[s].begin(), times[s].end());
+        }
+        std::sort(all.begin(), all.end());
+        bench_row("submit_loop", submitters, total / all.size());
+        bench_row("submit_p50", submitters, all[all.size()/2]);
+        bench_row("submit_p99", submitters, all[all.size()*99/100]);
+    }
+    ct_fini();
+    return 0;
+}
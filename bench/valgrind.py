@@ -0,0 +1,128 @@
+#!/usr/bin/python
+'''Valgrind checker slowdown: runs test programs natively (CT_SCHED=valgrind, which runs serially
+and only talks to the tool when under it) and under valgrind --tool=checkedthreads, and reports
+the wall time of each and their ratio, as well as the tool's shadow memory page lookups
+per second, peak shadow memory and allocator calls per loop (from --stats=yes). needs the tool to be built and installed (make valgrind).
+
+* sort: test/sort.cpp - quicksort and mergesort through nested ctx_invoke.
+* nested: test/nested.cpp - a 10x10 nested ctx_for loop; mostly the tool's startup cost.
+* nesting: bench/nesting.cpp - ctx_invoke nested 1 to 16 levels deep over a 4MB array;
+  the cost of inheriting and committing ownership across levels.
+* grain: test/grain.cpp - a 64M-element array initialized outside any loop, then a ctx_for
+  of 64M/grain iterations; the cost per iteration of the tool's client requests, and per store
+  made while checking is inactive.
+* loops: bench/loops.cpp - 2000 short ctx_for loops with short serial phases between them, checked
+  with --serial-threshold-ms=0 (serial code is uninstrumented after every loop, so all translations
+  are discarded twice per loop), the default threshold (the serial phases are too short to be worth
+  it, so code stays instrumented) and --instrument-serial=yes (never discarded); the cost of
+  retranslating versus that of running serial code instrumented.
+
+results go to bin/valgrind_bench.json.
+'''
+import os
+import sys
+import time
+import re
+import json
+import commands
+sys.path.insert(0, os.path.join(os.path.dirname(sys.argv[0]), '..'))
+import build
+
+if 'C++11' not in build.enabled:
+    print 'the benchmarks need C++11 - not building them'
+    sys.exit(0)
+
+verbose = build.verbose
+runs = int(os.getenv('CT_BENCH_RUNS',3))
+
+workloads = [('sort',str(1024*256)), ('nested','')] + [('nesting',str(depth)) for depth in [1,4,8,16]] + \
+            [('grain',str(grain)) for grain in [64,4096]]
+grain_n = 64*1024*1024
+
+print '\nbuilding benchmarks'
+for test in 'sort.cpp nested.cpp grain.cpp'.split():
+    build.buildtest(test)
+build.buildtest('nesting.cpp',dir='bench')
+build.buildtest('loops.cpp',dir='bench')
+
+def run(command):
+    '''the best wall time of several runs, in seconds, and the output of the last run'''
+    best = None
+    for r in range(runs):
+        if verbose:
+            print ' ','running',command
+        start = time.time()
+        status,output = commands.getstatusoutput(command)
+        elapsed = time.time() - start
+        if status != 0:
+            print ' ',command,'FAILED'
+            print output
+            sys.exit(1)
+        best = elapsed if best is None else min(best,elapsed)
+    return best,output
+
+def stats(output):
+    '''the numbers in the tool's "checkedthreads: stats - N name, ..." line'''
+    m = re.search(r'checkedthreads: stats - (.*)',output)
+    return dict([(name,int(n)) for n,name in re.findall(r'(\d+) ([a-z ]+)',m.group(1))]) if m else {}
+
+print '\nrunning benchmarks (best of %d runs)'%runs
+
+rows = []
+for name,args in workloads:
+    native,_ = run('env CT_SCHED=valgrind ./bin/%s %s'%(name,args))
+    checked,output = run('env CT_SCHED=valgrind valgrind --tool=checkedthreads --stats=yes ./bin/%s %s'%(name,args))
+    row = dict(benchmark=name,args=args,native=native,checked=checked,slowdown=checked/native)
+    row.update(stats(output))
+    m = re.search(r'time: (\d+)',output)
+    if m:
+        row['loop usec'] = int(m.group(1))
+    rows.append(row)
+
+loops_args = '2000 16'
+switching = [('--serial-threshold-ms=0','threshold 0'),('','default'),('--instrument-serial=yes','instrument serial')]
+native,_ = run('env CT_SCHED=valgrind ./bin/loops %s'%loops_args)
+for flags,setting in switching:
+    checked,output = run('env CT_SCHED=valgrind valgrind --tool=checkedthreads --stats=yes %s ./bin/loops %s'%(flags,loops_args))
+    row = dict(benchmark='loops',args=loops_args,setting=setting,native=native,checked=checked,slowdown=checked/native)
+    row.update(stats(output))
+    rows.append(row)
+
+json.dump(rows,open('bin/valgrind_bench.json','w'),indent=1)
+
+print
+print '%-24s%12s%12s%12s%16s%12s%12s%12s'%('benchmark','native','checked','slowdown','lookups/sec','walks','shadow MB',
+                                          'allocs/loop')
+for row in rows:
+    if row['benchmark'] == 'loops':
+        continue
+    lookups = row.get('page lookups',0)
+    walks = row.get('table walks',0)
+    loops = row.get('loops',0)
+    print '%-24s%12.3f%12.3f%11.1fx%16.0f%11.1f%%%12.1f%12.2f'%(('%s(%s)'%(row['benchmark'],row['args'])).replace('()',''),
+                                      row['native'],row['checked'],row['slowdown'],lookups/row['checked'],
+                                      100.*walks/lookups if lookups else 0,row.get('peak shadow bytes',0)/1e6,
+                                      float(row.get('allocator calls',0))/loops if loops else 0)
+print '\n(seconds of wall time; walks are the page lookups missing the page cache; shadow MB is the peak.)'
+
+# nested is mostly the tool's startup, which isn't part of the stores outside the loop
+startup = [row['checked'] for row in rows if row['benchmark'] == 'nested'][0]
+print
+print '%-24s%12s%16s%16s'%('grain','iterations','usec/iteration','nsec/store')
+for row in rows:
+    if row['benchmark'] != 'grain':
+        continue
+    iterations = grain_n/int(row['args'])
+    loop = row['loop usec']/1e6
+    print '%-24s%12d%16.2f%16.2f'%('grain(%s)'%row['args'],iterations,1e6*loop/iterations,
+                                  1e9*max(row['checked']-loop-startup,0)/grain_n)
+print '\n(checked; usec/iteration is the loop time per iteration, nsec/store the time per store outside the loop.)'
+
+print
+print '%-24s%12s%12s%16s'%('loops(%s)'%loops_args,'checked','slowdown','retranslations')
+for row in rows:
+    if row['benchmark'] != 'loops':
+        continue
+    print '%-24s%12.3f%11.1fx%16d'%(row['setting'],row['checked'],row['slowdown'],row.get('retranslations',0))
+print '\n(checked; retranslations count the times all translations were discarded.)'
+print '\nwrote bin/valgrind_bench.json'
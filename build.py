@@ -26,8 +26,8 @@ those schedulers built into checkedthreads.
 '''
 
 dirs = 'obj lib bin'.split()
-srcsc = 'ct_api.c serial_imp.c pthreads_imp.c openmp_imp.c shuffle_imp.c valgrind_imp.c'.split() +\
-        'lock_based_queue.c nprocs.c work_item.c'.split()
+srcsc = 'ct_api.c serial_imp.c pthreads_imp.c openmp_imp.c shuffle_imp.c valgrind_imp.c fork_imp.c'.split() +\
+        'lock_based_queue.c nprocs.c work_item.c stats.c trace.c grain.c perm.c'.split()
 srcsxx = 'ctx_api.cpp tbb_imp.cpp'.split()
 libc = 'checkedthreads'
 libxx = 'checkedthreads++'
@@ -140,10 +140,10 @@ def link(libname,srcs,shared=False):
     else:
         update('ar cr %s %s'%(lib,' '.join(objs)),[lib],objs)
 
-def buildtest(test,lib_postfix=''):
+def buildtest(test,lib_postfix='',dir='test'):
     name = test.split('.')[0]+lib_postfix
     bin = 'bin/'+name
-    src = 'test/'+test
+    src = dir+'/'+test
     cc = compiler(test)
     lib = {'gcc':libc,'g++':libxx}[cc]+lib_postfix
     update('%s %s -o %s lib/lib%s.a -I include %s'%(cc,src,bin,lib,all_enabled('linker_flags')),[bin],[src])
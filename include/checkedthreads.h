@@ -19,11 +19,23 @@ typedef struct {
 
    environment variables:
 
-   $CT_SCHED: serial, shuffle, valgrind, openmp, tbb, pthreads.
+   $CT_SCHED: serial, shuffle, valgrind, openmp, tbb, pthreads, pshuffle, fork.
    $CT_THREADS: number of threads, including main; "0" means "a thread per core".
    $CT_VERBOSE: 2(print indexes), 1(print loops), 0(silent-default).
-   $CT_RAND_SEED: seed for schedulers randomizing order (shuffle & valgrind).
+   $CT_RAND_SEED: seed for schedulers randomizing order (shuffle, pshuffle, fork & valgrind).
    $CT_RAND_REV: reverse each random index sequence yielded by the given seed.
+   $CT_EXPLORE: a state file making successive runs alternate between a new seed
+                and the reverse of the last run, covering all index pairs' orders.
+   $CT_STATS_FILE: publish scheduler statistics in this file (see ct_get_stats.)
+   $CT_TRACE: write a timeline of loops and worker activity to this file at ct_fini
+              (in the Chrome trace-event format.)
+   $CT_GRAIN: "auto" makes the parallel schedulers coalesce cheap indexes into
+              chunks, sized per call site from measured per-index cost.
+   $CT_GRAIN_USEC: the chunk duration $CT_GRAIN=auto aims at (default: 50.)
+   $CT_SPIN_USEC: how long idle pthreads workers spin before parking (default: 0),
+              or "adaptive" to learn it from the time between loops.
+   $CT_IDLE_TIMEOUT_MSEC: pthreads workers parked for that long exit, to be
+              re-spawned by the next loop (default: 0, never.)
 
    note that the parallel schedulers such as openmp and tbb currently
    specify two things which are conceptually separate: the "threading platform"
@@ -61,6 +73,18 @@ void ct_invoke(const ct_task tasks[], ct_canceller* c);
 typedef void (*ct_ind_func)(int ind, void* context);
 void ct_for(int n, ct_ind_func f, void* context, ct_canceller* c);
 
+/* priority classes: the pthreads scheduler runs the indexes of high-priority
+   loops before those of normal ones. a running index is never preempted, but
+   workers look for high-priority work every time they claim the next index
+   of a normal loop. the other schedulers ignore the priority. ct_for and
+   ct_invoke are CT_PRIO_DEFAULT: a loop nested in another loop's index gets
+   the enclosing loop's priority, and other loops are CT_PRIO_NORMAL. */
+#define CT_PRIO_DEFAULT (-1)
+#define CT_PRIO_NORMAL 0
+#define CT_PRIO_HIGH 1
+#define CT_NUM_PRIOS 2
+void ct_for_prio(int n, ct_ind_func f, void* context, ct_canceller* c, int priority);
+
 /* under Valgrind or other ownership-tracking environment,
    returns an ID of the owner of the given address; elsewhere,
    always returns CT_OWNER_UNKNOWN */
@@ -68,6 +92,71 @@ void ct_for(int n, ct_ind_func f, void* context, ct_canceller* c);
 #define CT_OWNER_UNKNOWN (-2) /* not under Valgrind or equivalent */
 int ct_debug_get_owner(const void* addr);
 
+/* statistics: each worker of a parallel scheduler (pthreads, openmp, tbb)
+   keeps its own counters, which are only summed when read. the serial
+   schedulers keep no statistics. */
+typedef struct {
+    unsigned long items; /* work items (whole loops or parts of loops) worked on */
+    unsigned long indexes; /* loop indexes executed (chunks with $CT_GRAIN=auto) */
+    double busy_sec; /* time spent running work items */
+    double idle_sec; /* time spent waiting for work */
+    unsigned long queue_full_indexes; /* indexes ct_for ran serially because the queue was full */
+    unsigned long empty_wakeups; /* wakeups that found no work */
+    unsigned long peak_queue_depth; /* max queue size observed after enqueueing */
+} ct_stats;
+
+/* fills *total with the sum over all workers (peak_queue_depth is the max
+   rather than the sum), and per_worker[0..max_workers-1] with per-worker
+   counters; both may be 0. returns the number of workers (0 if the scheduler
+   keeps no statistics.) the main thread counts as worker 0. */
+int ct_get_stats(ct_stats* total, ct_stats* per_worker, int max_workers);
+
+/* with $CT_STATS_FILE set, the counters are kept in a shared mapping of
+   that file, which other processes can poll while the program runs.
+   the file is an array of stride-byte slots: the header takes all of slot 0,
+   and worker i's entry, starting with a ct_stats struct, is at offset
+   (i+1)*stride. pollers should wait for magic to read CT_STATS_MAGIC.
+   only pthreads fills all the counters; openmp and tbb leave idle_sec,
+   queue_full_indexes, empty_wakeups and peak_queue_depth at 0, since their
+   own runtimes do the queueing and the waiting. */
+#define CT_STATS_MAGIC 0x53544374 /* "tCTS" */
+typedef struct {
+    int magic;
+    int num_workers;
+    int stride;
+    int pid;
+} ct_stats_file_header;
+
+/* pools: by default, all loops run in one pool of $CT_THREADS threads.
+   ct_alloc_pool creates another pool, with its own threads, queues and
+   statistics, so that different subsystems don't compete for one set of
+   threads. num_threads counts the thread submitting the loops, as with
+   $CT_THREADS; 0 means a thread per core. a loop submitted to a pool runs
+   there, and so do all the loops nested in it. pools are only isolated
+   under pthreads - the other schedulers run everything in their one pool.
+   pools must be freed before ct_fini. */
+typedef struct ct_pool ct_pool;
+
+ct_pool* ct_alloc_pool(int num_threads);
+void ct_free_pool(ct_pool* pool);
+void ct_pool_for(ct_pool* pool, int n, ct_ind_func f, void* context, ct_canceller* c);
+void ct_pool_invoke(ct_pool* pool, const ct_task tasks[], ct_canceller* c);
+/* calls func(arg) such that all the loops it runs go to pool */
+void ct_pool_run(ct_pool* pool, ct_task_func func, void* arg);
+/* ct_get_stats reports the calling thread's pool: the default one, or the one
+   whose loop we're running; this reports the given pool. */
+int ct_pool_get_stats(ct_pool* pool, ct_stats* total, ct_stats* per_worker, int max_workers);
+
+/* resizing: ct_set_num_threads changes the number of threads of the calling
+   thread's pool (counting the submitting thread, as $CT_THREADS does; 0 means
+   a thread per core), even while loops run in it. new threads join the loops
+   in flight; surplus threads exit once they're done with their current work.
+   with $CT_IDLE_TIMEOUT_MSEC set, a pool's threads also exit after idling for
+   that long, and are re-spawned by the next loop submitted to the pool.
+   only pthreads pools are resized; elsewhere, these do nothing. */
+void ct_set_num_threads(int num_threads);
+void ct_pool_set_num_threads(ct_pool* pool, int num_threads);
+
 #ifdef __cplusplus
 } /* extern "C" */
 
@@ -77,7 +166,7 @@ int ct_debug_get_owner(const void* addr);
 #include <functional>
 typedef std::function<void(int)> ctx_ind_func;
 
-void ctx_for(int n, const ctx_ind_func& f, ct_canceller* c=0);
+void ctx_for(int n, const ctx_ind_func& f, ct_canceller* c=0, int priority=CT_PRIO_DEFAULT);
 
 typedef std::function<void(void)> ctx_task_func;
 struct ctx_task_node_ {
@@ -99,6 +188,9 @@ void ctx_invoke(const First& first, Rest... rest) {
     ctx_invoke_(&head, rest...);
 }
 
+/* calls f() such that all the loops/invokes it runs go to pool (see ct_pool_run.) */
+void ctx_pool_run(ct_pool* pool, const ctx_task_func& f);
+
 #endif /* CT_CXX11 */
 
 #endif /* __cplusplus */
@@ -9,5 +9,14 @@
 #define ATOMIC_FETCH_THEN_INCR(ptr,incr) __sync_fetch_and_add(ptr,incr)
 #define ATOMIC_FETCH_THEN_DECR(ptr,decr) __sync_fetch_and_sub(ptr,decr)
 #define ATOMIC_COMPARE_AND_SWAP(ptr,oldval,newval) __sync_val_compare_and_swap(ptr,oldval,newval)
+/* a full barrier: no load or store moves across it in either direction. */
+#define ATOMIC_MEMORY_BARRIER() __sync_synchronize()
+
+/* a hint to the CPU that we're in a spin-wait loop */
+#if defined(__i386__) || defined(__x86_64__)
+#define CPU_PAUSE() __asm__ __volatile__("pause")
+#else
+#define CPU_PAUSE() ATOMIC_MEMORY_BARRIER()
+#endif
 
 #endif
@@ -2,6 +2,9 @@
 #include <string.h>
 #include <stdio.h>
 #include "imp.h"
+#include "trace.h"
+#include "stats.h"
+#include "grain.h"
 
 extern ct_imp g_ct_tbb_imp;
 extern ct_imp g_ct_serial_imp;
@@ -9,6 +12,8 @@ extern ct_imp g_ct_openmp_imp;
 extern ct_imp g_ct_shuffle_imp;
 extern ct_imp g_ct_valgrind_imp;
 extern ct_imp g_ct_pthreads_imp;
+extern ct_imp g_ct_pshuffle_imp;
+extern ct_imp g_ct_fork_imp;
 
 ct_imp* g_ct_imps[] = {
     &g_ct_tbb_imp,
@@ -17,9 +22,14 @@ ct_imp* g_ct_imps[] = {
     &g_ct_shuffle_imp,
     &g_ct_valgrind_imp,
     &g_ct_pthreads_imp,
+    &g_ct_pshuffle_imp,
+    &g_ct_fork_imp,
     0
 };
 
+/* the parallel schedulers, in the order of preference for the default */
+const char* g_ct_parallel_scheds[] = {"pthreads","tbb","openmp",0};
+
 ct_imp* g_ct_pimpl;
 int g_ct_verbose;
 ct_canceller* g_ct_default_canceller;
@@ -54,7 +64,7 @@ ct_imp* ct_sched(const char* name) {
 /* choosing the default scheduler isn't trivial because we don't easily know
    which are available; it depends on config.h and on the library we're linked into. */
 const char* ct_default_sched() {
-    const char* prefs[] = {"pthreads","tbb","openmp",0};
+    const char** prefs = g_ct_parallel_scheds;
     int j=0;
     while(prefs[j]) {
         int i=0;
@@ -70,6 +80,16 @@ const char* ct_default_sched() {
     return "serial"; /* if no parallel scheduler is available, is a serial one better than crashing?.. */
 }
 
+int ct_parallel_sched(const char* name) {
+    int i;
+    for(i=0; g_ct_parallel_scheds[i]; ++i) {
+        if(strcmp(g_ct_parallel_scheds[i], name) == 0) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
 void ct_init(const ct_env_var* env) {
     const char* default_sched = ct_default_sched();
     const char* sched = ct_getenv(env, "CT_SCHED", default_sched);
@@ -82,8 +102,10 @@ void ct_init(const ct_env_var* env) {
     /* TODO: it'd be nice to warn when verbosity>1 won't really work -
        that is, with truly parallel schedulers. */
     g_ct_verbose = atoi(ct_getenv(env, "CT_VERBOSE", "0"));
+    ct_trace_init(ct_getenv(env, "CT_TRACE", 0));
 
     g_ct_pimpl->imp_init(env);
+    ct_grain_init(env, ct_parallel_sched(g_ct_pimpl->name), g_ct_pimpl->imp_num_threads);
 
     g_ct_default_canceller = ct_alloc_canceller();
 
@@ -94,8 +116,10 @@ void ct_init(const ct_env_var* env) {
 
 void ct_fini(void) {
     ct_free_canceller(g_ct_default_canceller);
+    ct_grain_fini();
     g_ct_pimpl->imp_fini();
     g_ct_pimpl = 0;
+    ct_trace_fini();
     if(g_ct_verbose) {
         printf("checkedthreads: finalized\n");
     }
@@ -128,6 +152,79 @@ int ct_cancelled(ct_canceller* c) {
     return c->cancelled;
 }
 
+ct_pool* ct_alloc_pool(int num_threads) {
+    ct_pool* pool = (ct_pool*)malloc(sizeof(ct_pool));
+    pool->sched_data = 0;
+    if(g_ct_pimpl->imp_pool_init) {
+        g_ct_pimpl->imp_pool_init(pool, num_threads);
+    }
+    return pool;
+}
+
+void ct_free_pool(ct_pool* pool) {
+    if(g_ct_pimpl->imp_pool_fini) {
+        g_ct_pimpl->imp_pool_fini(pool);
+    }
+    free(pool);
+}
+
+void* ct_pool_enter_(ct_pool* pool) {
+    return g_ct_pimpl->imp_pool_enter ? g_ct_pimpl->imp_pool_enter(pool) : 0;
+}
+
+void ct_pool_leave_(void* prev) {
+    if(g_ct_pimpl->imp_pool_leave) {
+        g_ct_pimpl->imp_pool_leave(prev);
+    }
+}
+
+void ct_pool_for(ct_pool* pool, int n, ct_ind_func f, void* context, ct_canceller* c) {
+    void* prev = ct_pool_enter_(pool);
+    ct_for(n, f, context, c);
+    ct_pool_leave_(prev);
+}
+
+void ct_pool_invoke(ct_pool* pool, const ct_task tasks[], ct_canceller* c) {
+    void* prev = ct_pool_enter_(pool);
+    ct_invoke(tasks, c);
+    ct_pool_leave_(prev);
+}
+
+void ct_pool_run(ct_pool* pool, ct_task_func func, void* arg) {
+    void* prev = ct_pool_enter_(pool);
+    func(arg);
+    ct_pool_leave_(prev);
+}
+
+void ct_set_num_threads(int num_threads) {
+    if(g_ct_pimpl->imp_set_num_threads) {
+        g_ct_pimpl->imp_set_num_threads(num_threads);
+    }
+}
+
+void ct_pool_set_num_threads(ct_pool* pool, int num_threads) {
+    void* prev = ct_pool_enter_(pool);
+    ct_set_num_threads(num_threads);
+    ct_pool_leave_(prev);
+}
+
+int ct_pool_get_stats(ct_pool* pool, ct_stats* total, ct_stats* per_worker, int max_workers) {
+    void* prev = ct_pool_enter_(pool);
+    int num_workers = ct_get_stats(total, per_worker, max_workers);
+    ct_pool_leave_(prev);
+    return num_workers;
+}
+
+int ct_get_stats(ct_stats* total, ct_stats* per_worker, int max_workers) {
+    if(g_ct_pimpl && g_ct_pimpl->imp_get_stats) {
+        return g_ct_pimpl->imp_get_stats(total, per_worker, max_workers);
+    }
+    if(total) {
+        memset(total, 0, sizeof(ct_stats));
+    }
+    return 0;
+}
+
 void ct_dispatch_task(int index, void* context) {
     const ct_task* tasks = (const ct_task*)context;
     const ct_task* t = tasks + index;
@@ -137,7 +234,7 @@ void ct_dispatch_task(int index, void* context) {
 void ct_invoke(const ct_task tasks[], ct_canceller* c) {
     int i;
     for(i=0; tasks[i].func; ++i);
-    ct_for(i, ct_dispatch_task, (void*)tasks, c);
+    ct_for_(i, ct_dispatch_task, (void*)tasks, c, CT_PRIO_DEFAULT, 0);
 }
 
 typedef struct {
@@ -151,7 +248,42 @@ void ct_verbose_ind_func(int index, void* context) {
     wc->next_func(index, wc->next_context);
 }
 
+void ct_sched_for(int n, ct_ind_func f, void* context, ct_canceller* c, int priority) {
+    if(g_ct_pimpl->imp_for_prio) {
+        g_ct_pimpl->imp_for_prio(n, f, context, c, priority);
+    }
+    else {
+        g_ct_pimpl->imp_for(n, f, context, c);
+    }
+}
+
+void ct_imp_for(int n, ct_ind_func f, void* context, ct_canceller* c, int priority, const ct_site* site) {
+    if(g_ct_grain_auto) {
+        ct_grain_for(ct_sched_for, n, f, context, c, priority, site);
+    }
+    else {
+        ct_sched_for(n, f, context, c, priority);
+    }
+}
+
 void ct_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
+    ct_for_prio(n, f, context, c, CT_PRIO_DEFAULT);
+}
+
+void ct_for_prio(int n, ct_ind_func f, void* context, ct_canceller* c, int priority) {
+    ct_site site;
+    site.f = f;
+    site.context_type = 0;
+    ct_for_(n, f, context, c, priority, &site);
+}
+
+void ct_for_(int n, ct_ind_func f, void* context, ct_canceller* c, int priority, const ct_site* site) {
+    if(priority < CT_PRIO_NORMAL) {
+        priority = CT_PRIO_DEFAULT; /* resolved by the scheduler, which knows the enclosing loop */
+    }
+    else if(priority >= CT_NUM_PRIOS) {
+        priority = CT_NUM_PRIOS-1;
+    }
     if(c == 0) {
         c = g_ct_default_canceller;
     }
@@ -170,10 +302,15 @@ void ct_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
             f = ct_verbose_ind_func;
             context = &wc;
         }
-        g_ct_pimpl->imp_for(n, f, context, c);
+        ct_imp_for(n, f, context, c, priority, site);
         printf("checkedthreads: ct_for(%d) ended\n",n);
     }
+    else if(g_ct_trace) {
+        double start = ct_seconds();
+        ct_imp_for(n, f, context, c, priority, site);
+        ct_trace_event(CT_TRACE_LOOP, start, ct_seconds(), n);
+    }
     else {
-        g_ct_pimpl->imp_for(n, f, context, c);
+        ct_imp_for(n, f, context, c, priority, site);
     }
 }
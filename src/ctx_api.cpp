@@ -1,4 +1,5 @@
 #include "checkedthreads.h"
+#include "imp.h"
 #include <cstdlib>
 #include <cstring>
 
@@ -7,8 +8,15 @@ void ctx_for_ind_func(int ind, void* context) {
     (*f)(ind);
 }
 
-void ctx_for(int n, const ctx_ind_func& f, ct_canceller* c) {
-    ct_for(n, ctx_for_ind_func, (void*)&f, c);
+void ctx_for(int n, const ctx_ind_func& f, ct_canceller* c, int priority) {
+    ct_site site = { ctx_for_ind_func, &f.target_type() };
+    ct_for_(n, ctx_for_ind_func, (void*)&f, c, priority, &site);
+}
+
+void ctx_pool_run(ct_pool* pool, const ctx_task_func& f) {
+    void* prev = ct_pool_enter_(pool);
+    f();
+    ct_pool_leave_(prev);
 }
 
 void ctx_invoke_ind_func(int ind, void* context) {
@@ -41,7 +49,7 @@ void ctx_invoke_(ctx_task_node_* head, ct_canceller* c) {
         ++n;
     }
 
-    ct_for(n, ctx_invoke_ind_func, tasks, c);
+    ct_for_(n, ctx_invoke_ind_func, tasks, c, CT_PRIO_DEFAULT, 0);
 
     if(tasks != local_tasks) {
         free(tasks);
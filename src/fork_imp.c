@@ -0,0 +1,637 @@
+/* the fork scheduler: a differential checker. each top-level loop runs twice at
+   once, in two processes: we fork() when the loop starts, the child runs the indexes
+   in the shuffled order, and the parent in the reverse order. then the pages either
+   process may have written are hashed and compared. a loop whose indexes don't
+   commute - that is, one which would give different results under different
+   parallel schedules - leaves them different, and we report it. the child then
+   exits, and the parent goes on with the program. nested loops run serially, in
+   their process's direction.
+
+   the pages written are found with Linux's soft-dirty bits where available
+   (CONFIG_MEM_SOFT_DIRTY); otherwise, all the pages present in the compared
+   mappings are hashed, which is slower for programs using lots of memory.
+   the compared mappings are the program's own writable ones - its data segment,
+   heap, stacks and anonymous mappings - but not those of the shared libraries,
+   whose internal state (say, libc's fork bookkeeping) differs in the child.
+
+   memory allocated by the loop's indexes gets different addresses in the two
+   orders, so words which point into the compared mappings in both processes are
+   taken to be equal - the pointers to the blocks, and the allocator's links
+   between them. (what's stored in the blocks can still differ, if blocks of
+   different sizes are allocated, or if the indexes fill them with different
+   things; then, we report a difference that a parallel run wouldn't have.)
+
+   what the loop writes outside memory would happen twice. the descriptors open
+   for writing when the loop starts - stdout, stderr, and the program's files and
+   sockets - point at /dev/null in the child, so those writes are the parent's
+   alone. but files opened by the loop's indexes are written by both processes. */
+#ifdef __linux__
+#define _GNU_SOURCE /* MAP_ANONYMOUS, pread */
+#endif
+#include "imp.h"
+#include "perm.h"
+
+#ifdef __linux__
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#define CT_FORK_MAX_RANGES (64*1024)
+#define CT_FORK_PAGEMAP_BATCH 512
+#define CT_FORK_SOFT_DIRTY ((uint64_t)1 << 55)
+#define CT_FORK_SWAPPED ((uint64_t)1 << 62)
+#define CT_FORK_PRESENT ((uint64_t)1 << 63)
+#define CT_FORK_UNMAPPED (~0UL) /* the "hash" of a page outside our mappings */
+#define CT_FORK_TCB_SIZE 4096 /* libc's thread descriptor (with the cached thread ID) */
+#define CT_FORK_MAX_EXCLUDED 3
+#define CT_FORK_MAX_FDS 1024 /* the writable descriptors the child silences */
+#define CT_FORK_POINTER 0x5054525054525054UL /* what we hash instead of a pointer */
+
+typedef struct {
+    char* start;
+    char* end;
+} ct_fork_range;
+
+/* the state differing between the two processes is kept here, or on the
+   stack below the loop's frame, and both are left out of the comparison */
+typedef struct {
+    int reverse; /* this process runs the loops in reverse */
+    int depth; /* loops running */
+    int loops; /* top-level loops started */
+    int reported; /* we only report the first loop that differs */
+    int soft_dirty; /* soft-dirty bits work */
+    long page_size;
+    ct_fork_range excluded[CT_FORK_MAX_EXCLUDED];
+    int num_excluded;
+    int fds[CT_FORK_MAX_FDS]; /* the descriptors open for writing when the loop started */
+    int num_fds;
+} ct_fork_state;
+
+ct_fork_state g_ct_fork;
+
+int ct_fork_clear_soft_dirty(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY), ok;
+    if(fd < 0) {
+        return 0;
+    }
+    ok = write(fd, "4", 1) == 1;
+    close(fd);
+    return ok;
+}
+
+int ct_fork_pagemap(int fd, const char* page, uint64_t* entries, long num_pages) {
+    size_t size = sizeof(uint64_t)*num_pages;
+    return fd >= 0 && pread(fd, entries, size, (off_t)((uintptr_t)page / g_ct_fork.page_size) * sizeof(uint64_t)) == (ssize_t)size;
+}
+
+/* some kernels accept the request to clear the bits, but never set them */
+int ct_fork_probe_soft_dirty(void) {
+    long size = g_ct_fork.page_size;
+    char* p = (char*)mmap(0, 2*size, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS, -1, 0);
+    uint64_t entries[2];
+    int fd, works = 0;
+    if(p == (char*)MAP_FAILED) {
+        return 0;
+    }
+    p[0] = p[size] = 1;
+    fd = open("/proc/self/pagemap", O_RDONLY);
+    if(ct_fork_clear_soft_dirty()) {
+        p[0] = 2;
+        works = ct_fork_pagemap(fd, p, entries, 2) &&
+                (entries[0] & CT_FORK_SOFT_DIRTY) && !(entries[1] & CT_FORK_SOFT_DIRTY);
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    munmap(p, 2*size);
+    return works;
+}
+
+char* ct_fork_alloc(size_t size) {
+    char* p = (char*)mmap(0, size ? size : 1, PROT_READ|PROT_WRITE, MAP_PRIVATE|MAP_ANONYMOUS|MAP_NORESERVE, -1, 0);
+    return p == (char*)MAP_FAILED ? 0 : p;
+}
+
+void ct_fork_free(void* p, size_t size) {
+    if(p) {
+        munmap(p, size ? size : 1);
+    }
+}
+
+int ct_fork_write(int fd, const void* buf, size_t size) {
+    const char* p = (const char*)buf;
+    while(size > 0) {
+        ssize_t done = write(fd, p, size);
+        if(done <= 0) {
+            return 0;
+        }
+        p += done;
+        size -= done;
+    }
+    return 1;
+}
+
+int ct_fork_read(int fd, void* buf, size_t size) {
+    char* p = (char*)buf;
+    while(size > 0) {
+        ssize_t done = read(fd, p, size);
+        if(done <= 0) {
+            return 0;
+        }
+        p += done;
+        size -= done;
+    }
+    return 1;
+}
+
+/* a /proc/self/maps line: "start-end perms offset dev inode [path]"; we keep the private
+   writable mappings, except for the shared libraries' (and the mapping at exclude.) */
+int ct_fork_parse_range(const char* line, const char* exe, ct_fork_range* prev_file, ct_fork_range* r,
+                        const char* exclude) {
+    char* p;
+    const char* path;
+    unsigned long start = strtoul(line, &p, 16), end;
+    int writable, anonymous, library;
+    if(*p != '-') {
+        return 0;
+    }
+    end = strtoul(p+1, &p, 16);
+    writable = p[0] == ' ' && p[1] == 'r' && p[2] == 'w' && p[4] == 'p';
+    path = strchr(line, '/');
+    anonymous = !path && !strchr(line, '[');
+    library = path && strcmp(path, exe) != 0;
+    r->start = (char*)start;
+    r->end = (char*)end;
+    if(path) {
+        *prev_file = *r;
+        if(library) {
+            prev_file->start = 0; /* marks a library's mapping */
+        }
+        return writable && !library;
+    }
+    /* a library's .bss follows its data segment, as an anonymous mapping */
+    if(anonymous && prev_file->end == r->start && prev_file->start == 0) {
+        return 0;
+    }
+    if(exclude >= r->start && exclude < r->end) {
+        return 0;
+    }
+    return writable && (anonymous || strstr(line, "[heap]") || strstr(line, "[stack"));
+}
+
+int ct_fork_read_maps(ct_fork_range* ranges, int max_ranges) {
+    char buf[4096], line[1024], exe[1024];
+    ct_fork_range prev_file = {0, 0};
+    ssize_t got, i, exe_len = readlink("/proc/self/exe", exe, sizeof exe - 1);
+    int fd = open("/proc/self/maps", O_RDONLY), len = 0, num = 0;
+    exe[exe_len > 0 ? exe_len : 0] = 0;
+    if(fd < 0) {
+        return 0;
+    }
+    while((got = read(fd, buf, sizeof buf)) > 0) {
+        for(i=0; i<got; ++i) {
+            if(buf[i] != '\n') {
+                if(len < (int)sizeof line - 1) {
+                    line[len++] = buf[i];
+                }
+                continue;
+            }
+            line[len] = 0;
+            len = 0;
+            if(num < max_ranges && ct_fork_parse_range(line, exe, &prev_file, &ranges[num], (const char*)ranges)) {
+                num++;
+            }
+        }
+    }
+    close(fd);
+    return num;
+}
+
+int ct_fork_mapped(const ct_fork_range* ranges, int num_ranges, const char* page) {
+    int lo = 0, hi = num_ranges;
+    while(lo < hi) {
+        int mid = (lo + hi) / 2;
+        if(page < ranges[mid].start) {
+            hi = mid;
+        }
+        else if(page >= ranges[mid].end) {
+            lo = mid + 1;
+        }
+        else {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* the pages we may have written since the loop started, in ascending order */
+long ct_fork_written_pages(const ct_fork_range* ranges, int num_ranges, char** pages) {
+    uint64_t entries[CT_FORK_PAGEMAP_BATCH];
+    uint64_t written = g_ct_fork.soft_dirty ? CT_FORK_SOFT_DIRTY : CT_FORK_PRESENT|CT_FORK_SWAPPED;
+    long size = g_ct_fork.page_size, num = 0;
+    int fd = open("/proc/self/pagemap", O_RDONLY), r;
+    for(r=0; r<num_ranges; ++r) {
+        char* p = ranges[r].start;
+        while(p < ranges[r].end) {
+            long k, batch = (ranges[r].end - p) / size;
+            int have;
+            if(batch > CT_FORK_PAGEMAP_BATCH) {
+                batch = CT_FORK_PAGEMAP_BATCH;
+            }
+            have = ct_fork_pagemap(fd, p, entries, batch);
+            for(k=0; k<batch; ++k) {
+                if(!have || (entries[k] & written)) {
+                    pages[num++] = p + k*size;
+                }
+            }
+            p += batch*size;
+        }
+    }
+    if(fd >= 0) {
+        close(fd);
+    }
+    return num;
+}
+
+int ct_fork_is_excluded(const char* p) {
+    int i;
+    for(i=0; i<g_ct_fork.num_excluded; ++i) {
+        if(p >= g_ct_fork.excluded[i].start && p < g_ct_fork.excluded[i].end) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+int ct_fork_page_has_excluded(const char* page) {
+    int i;
+    for(i=0; i<g_ct_fork.num_excluded; ++i) {
+        if(page < g_ct_fork.excluded[i].end && page + g_ct_fork.page_size > g_ct_fork.excluded[i].start) {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* a word pointing into our mappings (as far as we can tell) */
+int ct_fork_is_pointer(const ct_fork_range* ranges, int num_ranges, unsigned long word) {
+    const char* p = (const char*)word;
+    return num_ranges > 0 && p >= ranges[0].start && p < ranges[num_ranges-1].end &&
+           ct_fork_mapped(ranges, num_ranges, p);
+}
+
+unsigned long ct_fork_hash(const ct_fork_range* ranges, int num_ranges, const char* page) {
+    const unsigned long* w = (const unsigned long*)page;
+    long i, num_words = g_ct_fork.page_size / sizeof(unsigned long);
+    int check = ct_fork_page_has_excluded(page);
+    unsigned long h = 0, word;
+    if(!ct_fork_mapped(ranges, num_ranges, page)) {
+        return CT_FORK_UNMAPPED;
+    }
+    for(i=0; i<num_words; ++i) {
+        if(check && ct_fork_is_excluded((const char*)&w[i])) {
+            continue;
+        }
+        word = ct_fork_is_pointer(ranges, num_ranges, w[i]) ? CT_FORK_POINTER : w[i];
+        h = (h + word) * 0x9e3779b1UL;
+        h ^= h >> 15;
+    }
+    return h;
+}
+
+/* everything below boundary on its stack is the scheduler's own frames */
+void ct_fork_exclude(const ct_fork_range* ranges, int num_ranges, const char* boundary) {
+    int r;
+    char* self = (char*)pthread_self();
+    g_ct_fork.num_excluded = 0;
+    for(r=0; r<num_ranges; ++r) {
+        if(boundary >= ranges[r].start && boundary < ranges[r].end) {
+            g_ct_fork.excluded[g_ct_fork.num_excluded].start = ranges[r].start;
+            g_ct_fork.excluded[g_ct_fork.num_excluded].end = (char*)boundary;
+            g_ct_fork.num_excluded++;
+        }
+    }
+    g_ct_fork.excluded[g_ct_fork.num_excluded].start = (char*)&g_ct_fork;
+    g_ct_fork.excluded[g_ct_fork.num_excluded].end = (char*)(&g_ct_fork + 1);
+    g_ct_fork.num_excluded++;
+    g_ct_fork.excluded[g_ct_fork.num_excluded].start = self;
+    g_ct_fork.excluded[g_ct_fork.num_excluded].end = self + CT_FORK_TCB_SIZE;
+    g_ct_fork.num_excluded++;
+}
+
+/* the pages which either process may have written, and their hashes */
+typedef struct {
+    ct_fork_range* ranges;
+    int num_ranges;
+    char** pages;
+    long num_pages;
+    long max_pages;
+} ct_fork_memory;
+
+void ct_fork_memory_init(ct_fork_memory* m, const char* boundary) {
+    int r;
+    m->ranges = (ct_fork_range*)ct_fork_alloc(sizeof(ct_fork_range)*CT_FORK_MAX_RANGES);
+    m->num_ranges = m->ranges ? ct_fork_read_maps(m->ranges, CT_FORK_MAX_RANGES) : 0;
+    m->max_pages = 0;
+    for(r=0; r<m->num_ranges; ++r) {
+        m->max_pages += (m->ranges[r].end - m->ranges[r].start) / g_ct_fork.page_size;
+    }
+    m->pages = (char**)ct_fork_alloc(sizeof(char*)*m->max_pages);
+    m->num_pages = m->pages ? ct_fork_written_pages(m->ranges, m->num_ranges, m->pages) : 0;
+    ct_fork_exclude(m->ranges, m->num_ranges, boundary);
+}
+
+void ct_fork_memory_fini(ct_fork_memory* m) {
+    ct_fork_free(m->ranges, sizeof(ct_fork_range)*CT_FORK_MAX_RANGES);
+    ct_fork_free(m->pages, sizeof(char*)*m->max_pages);
+}
+
+/* the child: sends the pages it wrote, gets all the pages written, sends their hashes,
+   and then the contents of the pages the parent asks for */
+void ct_fork_child(int to_parent, int from_parent, const char* boundary) {
+    ct_fork_memory m;
+    long num_pages, i;
+    char** pages = 0;
+    unsigned long* hashes = 0;
+    char* page;
+    ct_fork_memory_init(&m, boundary);
+    if(!ct_fork_write(to_parent, &m.num_pages, sizeof m.num_pages) ||
+       !ct_fork_write(to_parent, m.pages, sizeof(char*)*m.num_pages) ||
+       !ct_fork_read(from_parent, &num_pages, sizeof num_pages)) {
+        _exit(1);
+    }
+    pages = (char**)ct_fork_alloc(sizeof(char*)*num_pages);
+    hashes = (unsigned long*)ct_fork_alloc(sizeof(unsigned long)*num_pages);
+    if(!pages || !hashes || !ct_fork_read(from_parent, pages, sizeof(char*)*num_pages)) {
+        _exit(1);
+    }
+    for(i=0; i<num_pages; ++i) {
+        hashes[i] = ct_fork_hash(m.ranges, m.num_ranges, pages[i]);
+    }
+    if(!ct_fork_write(to_parent, hashes, sizeof(unsigned long)*num_pages)) {
+        _exit(1);
+    }
+    while(ct_fork_read(from_parent, &page, sizeof page) && page) {
+        if(!ct_fork_mapped(m.ranges, m.num_ranges, page) || !ct_fork_write(to_parent, page, g_ct_fork.page_size)) {
+            _exit(1);
+        }
+    }
+    _exit(0);
+}
+
+/* merges two ascending page lists, dropping the duplicates */
+long ct_fork_merge(char** a, long num_a, char** b, long num_b, char** out) {
+    long i = 0, j = 0, num = 0;
+    while(i < num_a || j < num_b) {
+        if(j == num_b || (i < num_a && a[i] < b[j])) {
+            out[num++] = a[i++];
+        }
+        else if(i == num_a || b[j] < a[i]) {
+            out[num++] = b[j++];
+        }
+        else {
+            out[num++] = a[i++];
+            j++;
+        }
+    }
+    return num;
+}
+
+/* the first word of page differing between us and the child (or 0 if the
+   page isn't mapped in one of us, or the child didn't send it.) as in
+   ct_fork_hash, two pointers into our mappings are taken to be equal. */
+const char* ct_fork_first_difference(const ct_fork_memory* m, int to_child, int from_child, char* page) {
+    char* theirs = ct_fork_alloc(g_ct_fork.page_size);
+    const char* diff = 0;
+    long i, num_words = g_ct_fork.page_size / sizeof(unsigned long);
+    if(theirs && ct_fork_mapped(m->ranges, m->num_ranges, page) && ct_fork_write(to_child, &page, sizeof page) &&
+       ct_fork_read(from_child, theirs, g_ct_fork.page_size)) {
+        const unsigned long* ours = (const unsigned long*)page;
+        const unsigned long* other = (const unsigned long*)theirs;
+        for(i=0; i<num_words && !diff; ++i) {
+            if(ours[i] != other[i] && !ct_fork_is_excluded((const char*)&ours[i]) &&
+               !(ct_fork_is_pointer(m->ranges, m->num_ranges, ours[i]) &&
+                 ct_fork_is_pointer(m->ranges, m->num_ranges, other[i]))) {
+                diff = (const char*)&ours[i];
+            }
+        }
+    }
+    ct_fork_free(theirs, g_ct_fork.page_size);
+    return diff;
+}
+
+/* the parent: compares its pages with the child's and reports the differences */
+void ct_fork_parent(int to_child, int from_child, const char* boundary, int n, pid_t child) {
+    ct_fork_memory m;
+    long num_theirs = 0, num_pages = 0, num_diffs = 0, i;
+    char** theirs = 0;
+    char** pages = 0;
+    unsigned long* hashes = 0;
+    char* first = 0;
+    char* none = 0;
+    const char* diff = 0;
+    int status = 0, ok;
+
+    ct_fork_memory_init(&m, boundary);
+    ok = ct_fork_read(from_child, &num_theirs, sizeof num_theirs);
+    if(ok) {
+        theirs = (char**)ct_fork_alloc(sizeof(char*)*num_theirs);
+        pages = (char**)ct_fork_alloc(sizeof(char*)*(num_theirs + m.num_pages));
+        hashes = (unsigned long*)ct_fork_alloc(sizeof(unsigned long)*(num_theirs + m.num_pages));
+        ok = theirs && pages && hashes && ct_fork_read(from_child, theirs, sizeof(char*)*num_theirs);
+    }
+    if(ok) {
+        num_pages = ct_fork_merge(m.pages, m.num_pages, theirs, num_theirs, pages);
+        ok = ct_fork_write(to_child, &num_pages, sizeof num_pages) &&
+             ct_fork_write(to_child, pages, sizeof(char*)*num_pages) &&
+             ct_fork_read(from_child, hashes, sizeof(unsigned long)*num_pages);
+    }
+    if(ok) {
+        for(i=0; i<num_pages; ++i) {
+            if(hashes[i] != ct_fork_hash(m.ranges, m.num_ranges, pages[i])) {
+                if(!first) {
+                    first = pages[i];
+                }
+                num_diffs++;
+            }
+        }
+        if(first) {
+            diff = ct_fork_first_difference(&m, to_child, from_child, first);
+        }
+        ct_fork_write(to_child, &none, sizeof none);
+    }
+    waitpid(child, &status, 0);
+
+    if(!ok) {
+        printf("checkedthreads: loop #%d, ct_for(%d), failed when run in the forward order (exit status 0x%x)\n",
+               g_ct_fork.loops, n, status);
+        g_ct_fork.reported = 1;
+    }
+    else if(num_diffs) {
+        printf("checkedthreads: loop #%d, ct_for(%d), gives different results when run in the forward and the reverse order"
+               " - %ld of the %ld pages written differ, the first difference at %p\n",
+               g_ct_fork.loops, n, num_diffs, num_pages, diff ? (const void*)diff : (const void*)first);
+        g_ct_fork.reported = 1;
+    }
+    fflush(stdout);
+
+    ct_fork_free(theirs, sizeof(char*)*num_theirs);
+    ct_fork_free(pages, sizeof(char*)*(num_theirs + m.num_pages));
+    ct_fork_free(hashes, sizeof(unsigned long)*(num_theirs + m.num_pages));
+    ct_fork_memory_fini(&m);
+}
+
+void ct_fork_run(int n, ct_ind_func f, void* context, ct_canceller* c) {
+    ct_perm perm;
+    ct_perm_scope scope, *enclosing = g_ct_perm_scope;
+    int i;
+    ct_perm_init(&perm, n, enclosing);
+    perm.reverse = g_ct_fork.reverse;
+    for(i=0; i<n; ++i) {
+        int ind;
+        if(c->cancelled) {
+            break;
+        }
+        ind = ct_perm_at(&perm, i);
+        ct_perm_enter(&scope, &perm, ind);
+        g_ct_perm_scope = &scope;
+        f(ind, context);
+    }
+    g_ct_perm_scope = enclosing;
+}
+
+/* finds the descriptors open for writing; called before fork(), so that
+   opendir's allocations are made in both processes */
+void ct_fork_list_fds(void) {
+    DIR* dir = opendir("/proc/self/fd");
+    struct dirent* entry;
+    g_ct_fork.num_fds = 0;
+    if(!dir) {
+        g_ct_fork.fds[g_ct_fork.num_fds++] = 1;
+        g_ct_fork.fds[g_ct_fork.num_fds++] = 2;
+        return;
+    }
+    while((entry = readdir(dir)) != 0 && g_ct_fork.num_fds < CT_FORK_MAX_FDS) {
+        int fd = atoi(entry->d_name), flags;
+        if(entry->d_name[0] == '.' || fd == dirfd(dir)) {
+            continue;
+        }
+        flags = fcntl(fd, F_GETFL);
+        if(flags >= 0 && (flags & O_ACCMODE) != O_RDONLY) {
+            g_ct_fork.fds[g_ct_fork.num_fds++] = fd;
+        }
+    }
+    closedir(dir);
+}
+
+/* the child's writes to the descriptors the program had open go nowhere
+   (and its reads from those opened for writing find nothing) */
+void ct_fork_silence_fds(void) {
+    int null = open("/dev/null", O_RDWR), i;
+    for(i=0; i<g_ct_fork.num_fds; ++i) {
+        dup2(null, g_ct_fork.fds[i]);
+    }
+    close(null);
+}
+
+void ct_fork_check(int n, ct_ind_func f, void* context, ct_canceller* c, const char* boundary) {
+    int to_parent[2], to_child[2];
+    pid_t child = -1;
+    ct_fork_list_fds();
+    if(pipe(to_parent) == 0) {
+        if(pipe(to_child) == 0) {
+            child = fork();
+            if(child < 0) {
+                close(to_child[0]);
+                close(to_child[1]);
+            }
+        }
+        if(child < 0) {
+            close(to_parent[0]);
+            close(to_parent[1]);
+        }
+    }
+    if(child < 0) { /* no checking, then */
+        ct_fork_run(n, f, context, c);
+        return;
+    }
+    if(child == 0) {
+        /* the parent's output is the program's output */
+        ct_fork_silence_fds();
+        close(to_parent[0]);
+        close(to_child[1]);
+        g_ct_fork.reverse = 0;
+        if(g_ct_fork.soft_dirty) {
+            ct_fork_clear_soft_dirty();
+        }
+        ct_fork_run(n, f, context, c);
+        ct_fork_child(to_parent[1], to_child[0], boundary);
+    }
+    close(to_parent[1]);
+    close(to_child[0]);
+    g_ct_fork.reverse = 1;
+    if(g_ct_fork.soft_dirty) {
+        ct_fork_clear_soft_dirty();
+    }
+    ct_fork_run(n, f, context, c);
+    ct_fork_parent(to_child[1], to_parent[0], boundary, n, child);
+    close(to_child[1]);
+    close(to_parent[0]);
+}
+
+void ct_shuffle_configure(const ct_env_var* env, int both_directions);
+
+void ct_fork_init(const ct_env_var* env) {
+    ct_shuffle_configure(env, 1); /* pass $CT_RAND_SEED and $CT_EXPLORE */
+    memset(&g_ct_fork, 0, sizeof g_ct_fork);
+    g_ct_fork.page_size = sysconf(_SC_PAGESIZE);
+    g_ct_fork.soft_dirty = ct_fork_probe_soft_dirty();
+    g_ct_fork.reverse = 1; /* the parent's direction */
+    /* only the child calls dup2 before the comparison; with lazy binding, that would leave
+       the program's GOT different in the two processes - so have it resolved by now */
+    dup2(-1, -1);
+}
+
+void ct_fork_fini(void) {
+}
+
+void ct_fork_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
+    volatile char boundary = 0; /* the stack below this is the scheduler's, not the program's */
+    g_ct_fork.depth++;
+    if(g_ct_fork.depth > 1 || g_ct_fork.reported) {
+        ct_fork_run(n, f, context, c);
+    }
+    else {
+        g_ct_fork.loops++;
+        ct_fork_check(n, f, context, c, (const char*)&boundary);
+    }
+    g_ct_fork.depth--;
+    (void)boundary;
+}
+
+ct_imp g_ct_fork_imp = {
+    "fork",
+    &ct_fork_init,
+    &ct_fork_fini,
+    &ct_fork_for,
+    0, 0, 0, /* cancelling functions */
+    0, /* statistics */
+    0, /* priorities */
+    0, 0, 0, 0, /* pools */
+    0, /* resizing */
+    0, /* pool size */
+};
+
+#else
+
+ct_imp g_ct_fork_imp;
+
+#endif
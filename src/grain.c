@@ -0,0 +1,158 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "grain.h"
+#include "stats.h"
+#include "nprocs.h"
+#include "atomic.h"
+
+#define CT_GRAIN_SITES 1024 /* a power of 2 */
+#define CT_GRAIN_LEARN 3 /* invocations measured with every index a separate task */
+#define CT_GRAIN_DRIFT 2 /* re-tune when the cost changes by more than this factor */
+#define CT_GRAIN_MAX_CHUNK (1024*1024)
+#define CT_GRAIN_CHUNKS_PER_THREAD 4 /* never coalesce into fewer chunks than that - leave room for load balancing */
+#define CT_GRAIN_SAMPLE 16 /* time one chunk out of that many - reading the clock costs as much as a small index */
+
+typedef struct {
+    volatile int state; /* 0: free, 1: being claimed, 2: ready */
+    ct_ind_func f;
+    const void* context_type;
+    int calls;
+    double cost_sec; /* per index; the average over the first calls, then a moving average */
+    double tuned_cost_sec; /* the cost the current chunk size was computed from */
+    int chunk;
+} ct_grain_site;
+
+/* a ct_for with coalesced indexes: index i of the loop passed to the scheduler
+   runs indexes [i*chunk, (i+1)*chunk) of the original loop */
+typedef struct {
+    ct_ind_func f;
+    void* context;
+    ct_canceller* canceller;
+    int n;
+    int chunk;
+    volatile long nsec; /* the time spent in the sampled chunks, summed over threads */
+    volatile long sampled; /* the number of indexes in the sampled chunks */
+} ct_grain_loop;
+
+int g_ct_grain_auto = 0;
+double g_ct_grain_target_sec;
+int g_ct_grain_threads; /* when the scheduler can't tell its pools' sizes */
+ct_imp_num_threads_func g_ct_grain_num_threads;
+ct_grain_site* g_ct_grain_sites = 0;
+
+void ct_grain_init(const ct_env_var* env, int parallel, ct_imp_num_threads_func num_threads) {
+    const char* grain = ct_getenv(env, "CT_GRAIN", "");
+    g_ct_grain_auto = parallel && strcmp(grain, "auto") == 0;
+    if(!g_ct_grain_auto) {
+        return;
+    }
+    g_ct_grain_target_sec = atof(ct_getenv(env, "CT_GRAIN_USEC", "50")) * 1e-6;
+    g_ct_grain_threads = atoi(ct_getenv(env, "CT_THREADS", "0"));
+    if(g_ct_grain_threads <= 0) {
+        g_ct_grain_threads = ct_nprocs();
+    }
+    g_ct_grain_num_threads = num_threads;
+    g_ct_grain_sites = (ct_grain_site*)calloc(CT_GRAIN_SITES, sizeof(ct_grain_site));
+}
+
+void ct_grain_fini(void) {
+    free(g_ct_grain_sites);
+    g_ct_grain_sites = 0;
+    g_ct_grain_auto = 0;
+}
+
+/* returns 0 if the table is full (the site is then simply not tuned.) */
+ct_grain_site* ct_grain_find(const ct_site* site) {
+    size_t h = (size_t)site->f ^ ((size_t)site->context_type >> 4);
+    int i;
+    h ^= h >> 12;
+    for(i=0; i<CT_GRAIN_SITES; ++i) {
+        ct_grain_site* s = &g_ct_grain_sites[(h+i) & (CT_GRAIN_SITES-1)];
+        if(s->state == 0 && ATOMIC_COMPARE_AND_SWAP(&s->state, 0, 1) == 0) {
+            s->f = site->f;
+            s->context_type = site->context_type;
+            s->chunk = 1;
+            ATOMIC_COMPARE_AND_SWAP(&s->state, 1, 2); /* a barrier making the fields visible first */
+            return s;
+        }
+        if(s->state == 2 && s->f == site->f && s->context_type == site->context_type) {
+            return s;
+        }
+        /* a site being claimed might be ours; moving on means that at worst,
+           a site gets two entries, and is tuned separately in each. */
+    }
+    return 0;
+}
+
+/* concurrent calls from the same site may race here; at worst, a sample is lost. */
+void ct_grain_update(ct_grain_site* s, double cost_sec) {
+    double chunk;
+    int calls = ++s->calls;
+    if(calls <= CT_GRAIN_LEARN) {
+        s->cost_sec += (cost_sec - s->cost_sec) / calls;
+        if(calls < CT_GRAIN_LEARN) {
+            return;
+        }
+    }
+    else {
+        s->cost_sec += (cost_sec - s->cost_sec) / 8;
+        if(s->cost_sec < s->tuned_cost_sec*CT_GRAIN_DRIFT && s->cost_sec*CT_GRAIN_DRIFT > s->tuned_cost_sec) {
+            return;
+        }
+    }
+    s->tuned_cost_sec = s->cost_sec;
+    chunk = s->cost_sec > 0 ? g_ct_grain_target_sec / s->cost_sec : CT_GRAIN_MAX_CHUNK;
+    s->chunk = chunk < 1 ? 1 : (chunk > CT_GRAIN_MAX_CHUNK ? CT_GRAIN_MAX_CHUNK : (int)chunk);
+}
+
+void ct_grain_chunk(int ind, void* context) {
+    ct_grain_loop* loop = (ct_grain_loop*)context;
+    int i = ind*loop->chunk;
+    int end = loop->n - i > loop->chunk ? i + loop->chunk : loop->n;
+    int sample = ind % CT_GRAIN_SAMPLE == 0;
+    double start = sample ? ct_seconds() : 0;
+    for(; i<end; ++i) {
+        if(loop->canceller->cancelled) {
+            break;
+        }
+        loop->f(i, loop->context);
+    }
+    if(sample) {
+        ATOMIC_FETCH_THEN_INCR(&loop->nsec, (long)((ct_seconds() - start)*1e9));
+        ATOMIC_FETCH_THEN_INCR(&loop->sampled, end - ind*loop->chunk);
+    }
+}
+
+void ct_grain_for(ct_imp_for_prio_func imp_for, int n, ct_ind_func f, void* context, ct_canceller* c,
+                  int priority, const ct_site* site) {
+    ct_grain_site* s = site && n > 0 ? ct_grain_find(site) : 0;
+    ct_grain_loop loop;
+    int max_chunk, threads;
+    if(!s) {
+        imp_for(n, f, context, c, priority);
+        return;
+    }
+    loop.f = f;
+    loop.context = context;
+    loop.canceller = c;
+    loop.n = n;
+    loop.chunk = s->chunk;
+    loop.nsec = 0;
+    loop.sampled = 0;
+    /* the pool the loop goes to - it could be another pool, or resized since ct_init */
+    threads = g_ct_grain_num_threads ? g_ct_grain_num_threads() : 0;
+    if(threads <= 0) {
+        threads = g_ct_grain_threads;
+    }
+    max_chunk = n / (threads*CT_GRAIN_CHUNKS_PER_THREAD);
+    if(loop.chunk > max_chunk) {
+        loop.chunk = max_chunk > 1 ? max_chunk : 1;
+    }
+
+    imp_for((n + loop.chunk - 1) / loop.chunk, ct_grain_chunk, &loop, c, priority);
+
+    if(!c->cancelled && loop.sampled) { /* a partial run says little about the cost */
+        ct_grain_update(s, loop.nsec*1e-9 / loop.sampled);
+    }
+}
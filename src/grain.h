@@ -0,0 +1,24 @@
+/*
+ * Adaptive grain size ($CT_GRAIN=auto). Each index of a ct_for is normally a
+ * separately scheduled task; here, the per-index cost of every call site is
+ * measured, and indexes are coalesced into chunks taking about $CT_GRAIN_USEC
+ * each. Only used with the parallel schedulers - the serial ones (and pshuffle)
+ * must keep running (and checking, or shuffling) each index separately.
+ */
+#ifndef CT_GRAIN_H_
+#define CT_GRAIN_H_
+
+#include "imp.h"
+
+extern int g_ct_grain_auto; /* non-0 if the grain size is tuned */
+
+/* parallel is 0 for the serial schedulers, which turns tuning off. num_threads
+   tells the size of the calling thread's pool (if 0, we go by $CT_THREADS.) */
+void ct_grain_init(const ct_env_var* env, int parallel, ct_imp_num_threads_func num_threads);
+void ct_grain_fini(void);
+
+/* runs imp_for with the indexes of f coalesced into chunks sized for the site */
+void ct_grain_for(ct_imp_for_prio_func imp_for, int n, ct_ind_func f, void* context, ct_canceller* c,
+                  int priority, const ct_site* site);
+
+#endif /* CT_GRAIN_H_ */
@@ -12,9 +12,15 @@ struct ct_canceller {
     void* sched_data; /* scheduler-specific */
 };
 
+struct ct_pool {
+    void* sched_data; /* scheduler-specific */
+};
+
 typedef void (*ct_imp_init_func)(const ct_env_var* env);
 typedef void (*ct_imp_fini_func)(void);
 typedef void (*ct_imp_for_func)(int n, ct_ind_func f, void* context, ct_canceller* c);
+/* a ct_for_prio; schedulers without priorities set it to 0, and imp_for is called instead. */
+typedef void (*ct_imp_for_prio_func)(int n, ct_ind_func f, void* context, ct_canceller* c, int priority);
 /* cancelling functions, as well as the scheduler-specific data in ct_canceller,
    are useful if the underlying framework has a notion of cancellation tokens
    (if it doesn't have such a notion, we simply check the cancelled flag every time
@@ -23,6 +29,23 @@ typedef void (*ct_imp_for_func)(int n, ct_ind_func f, void* context, ct_cancelle
 typedef void (*ct_imp_canceller_init_func)(ct_canceller* c);
 typedef void (*ct_imp_canceller_fini_func)(ct_canceller* c);
 typedef void (*ct_imp_cancel_func)(ct_canceller* c);
+/* implements ct_get_stats; schedulers keeping no statistics set it to 0. */
+typedef int (*ct_imp_get_stats_func)(ct_stats* total, ct_stats* per_worker, int max_workers);
+/* pools: schedulers which don't keep pools of their own set all of these to 0,
+   and then everything runs in their one pool. a thread entering a pool submits
+   its loops (as well as those nested in them) to that pool, and gets the pool's
+   statistics from imp_get_stats, until it leaves. */
+typedef void (*ct_imp_pool_init_func)(ct_pool* pool, int num_threads);
+typedef void (*ct_imp_pool_fini_func)(ct_pool* pool);
+typedef void* (*ct_imp_pool_enter_func)(ct_pool* pool); /* returns what to pass to imp_pool_leave */
+typedef void (*ct_imp_pool_leave_func)(void* prev);
+/* implements ct_set_num_threads for the calling thread's pool; 0 if the scheduler
+   can't resize its pools (and then ct_set_num_threads does nothing.) */
+typedef void (*ct_imp_set_num_threads_func)(int num_threads);
+/* the number of threads running the calling thread's loops (counting the thread
+   submitting them, as $CT_THREADS does), which changes with pools and resizing;
+   0 for the serial schedulers. */
+typedef int (*ct_imp_num_threads_func)(void);
 
 typedef struct {
     const char* name;
@@ -32,10 +55,33 @@ typedef struct {
     ct_imp_canceller_init_func imp_canceller_init; /* may be 0 */
     ct_imp_canceller_fini_func imp_canceller_fini; /* may be 0 */
     ct_imp_cancel_func imp_cancel; /* may be 0 */
+    ct_imp_get_stats_func imp_get_stats; /* may be 0 */
+    ct_imp_for_prio_func imp_for_prio; /* may be 0 */
+    ct_imp_pool_init_func imp_pool_init; /* may be 0 */
+    ct_imp_pool_fini_func imp_pool_fini; /* may be 0 */
+    ct_imp_pool_enter_func imp_pool_enter; /* may be 0 */
+    ct_imp_pool_leave_func imp_pool_leave; /* may be 0 */
+    ct_imp_set_num_threads_func imp_set_num_threads; /* may be 0 */
+    ct_imp_num_threads_func imp_num_threads; /* may be 0 */
 } ct_imp;
 
 const char* ct_getenv(const ct_env_var* env, const char* name, const char* default_value);
 
+/* a call site is identified by the index function and, in the C++ API,
+   the type of the function object (all ctx_for calls share the index function.) */
+typedef struct {
+    ct_ind_func f;
+    const void* context_type;
+} ct_site;
+
+/* ct_for_prio with the call site used for grain size tuning; site is 0 for loops
+   which shouldn't be tuned, such as ct_invoke's (tasks are rarely alike.) */
+void ct_for_(int n, ct_ind_func f, void* context, ct_canceller* c, int priority, const ct_site* site);
+
+/* make the calling thread's loops run in pool until ct_pool_leave_ */
+void* ct_pool_enter_(ct_pool* pool);
+void ct_pool_leave_(void* prev);
+
 #ifdef __cplusplus
 }
 #endif
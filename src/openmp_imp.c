@@ -2,31 +2,73 @@
 
 #ifdef CT_OPENMP
 
+#include <omp.h>
+#include "stats.h"
+#include "trace.h"
+
+ct_stats_table g_ct_openmp_stats;
+
 void ct_openmp_init(const ct_env_var* env) {
-    (void)env;
+    ct_stats_table_init(&g_ct_openmp_stats, omp_get_max_threads(), ct_getenv(env, "CT_STATS_FILE", 0));
 }
 
 void ct_openmp_fini(void) {
+    ct_stats_table_fini(&g_ct_openmp_stats);
+}
+
+/* the thread number in the outermost team - inner teams of nested loops
+   are numbered from 0 again, so omp_get_thread_num() could be shared by
+   several threads. */
+int ct_openmp_worker(void) {
+    return omp_get_level() ? omp_get_ancestor_thread_num(1) : 0;
 }
 
 void ct_openmp_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
-    int i;
     int cancelled = 0;
-#pragma omp parallel for schedule(dynamic,1)
-    for(i=0; i<n; ++i) {
-        if(!cancelled && !c->cancelled) {
-          f(i, context);
-          cancelled = c->cancelled;
+#pragma omp parallel
+    {
+        ct_stats* stats = ct_stats_of(&g_ct_openmp_stats, ct_openmp_worker());
+        double start = ct_seconds();
+        int i, done = 0;
+#pragma omp for schedule(dynamic,1) nowait
+        for(i=0; i<n; ++i) {
+            if(!cancelled && !c->cancelled) {
+              f(i, context);
+              cancelled = c->cancelled;
+              ++done;
+            }
+        }
+        if(done) {
+            double end = ct_seconds();
+            stats->items++;
+            stats->indexes += done;
+            stats->busy_sec += end - start;
+            if(g_ct_trace) {
+                ct_trace_event(CT_TRACE_CHUNK, start, end, done);
+            }
         }
     }
 }
 
+int ct_openmp_get_stats(ct_stats* total, ct_stats* per_worker, int max_workers) {
+    return ct_stats_table_get(&g_ct_openmp_stats, total, per_worker, max_workers);
+}
+
+int ct_openmp_num_threads(void) {
+    return omp_get_max_threads();
+}
+
 ct_imp g_ct_openmp_imp = {
     "openmp",
     &ct_openmp_init,
     &ct_openmp_fini,
     &ct_openmp_for,
     0, 0, 0, /* cancelling functions */
+    &ct_openmp_get_stats,
+    0, /* priorities */
+    0, 0, 0, 0, /* pools */
+    0, /* resizing */
+    &ct_openmp_num_threads,
 };
 
 #else
@@ -0,0 +1,142 @@
+#define _POSIX_C_SOURCE 200112L /* fdopen, ftruncate */
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "perm.h"
+#include "atomic.h"
+
+#define CT_PERM_MASK 0xffffffffUL /* unsigned long may be wider than 32 bits */
+
+unsigned long g_ct_perm_seed = 0;
+int g_ct_perm_reverse = 0;
+volatile unsigned long g_ct_perm_loops = 0; /* top-level loops started since ct_perm_configure */
+ct_perm_scope* g_ct_perm_scope = 0;
+
+/* a 32-bit integer hash with good avalanche (the "lowbias32" constants) */
+unsigned long ct_perm_mix(unsigned long x) {
+    x &= CT_PERM_MASK;
+    x ^= x >> 16;
+    x = (x * 0x7feb352dUL) & CT_PERM_MASK;
+    x ^= x >> 15;
+    x = (x * 0x846ca68bUL) & CT_PERM_MASK;
+    x ^= x >> 16;
+    return x;
+}
+
+void ct_perm_configure(unsigned long seed, int reverse) {
+    g_ct_perm_seed = seed;
+    g_ct_perm_reverse = reverse;
+    g_ct_perm_loops = 0;
+}
+
+/* opens the state file for reading and updating, locked for writing - so that runs
+   started at once each take the next run number, rather than all taking the same
+   one (or reading the file while another run rewrites it.) */
+FILE* ct_perm_lock_state(const char* state_file) {
+    struct flock lock;
+    FILE* f;
+    int fd = open(state_file, O_RDWR | O_CREAT, 0644);
+    if(fd < 0) {
+        return 0;
+    }
+    memset(&lock, 0, sizeof lock);
+    lock.l_type = F_WRLCK;
+    lock.l_whence = SEEK_SET; /* l_start = l_len = 0: the whole file */
+    while(fcntl(fd, F_SETLKW, &lock) != 0) {
+        if(errno != EINTR) {
+            break; /* no locking on this file system - carry on without */
+        }
+    }
+    f = fdopen(fd, "r+");
+    if(!f) {
+        close(fd);
+    }
+    return f;
+}
+
+void ct_perm_explore(const char* state_file, unsigned long seed, int both_directions) {
+    unsigned long runs = 0, rounds = 0, value;
+    int reverse;
+    char key[64];
+    FILE* f = ct_perm_lock_state(state_file);
+    if(f) {
+        while(fscanf(f, "%63s %lu", key, &value) == 2) {
+            if(strcmp(key, "runs") == 0) {
+                runs = value;
+            }
+            else if(strcmp(key, "seed") == 0) {
+                seed = value;
+            }
+        }
+    }
+    /* run 2k runs round k's permutations forward, and run 2k+1 in reverse */
+    rounds = both_directions ? runs : runs / 2;
+    reverse = both_directions ? 0 : (int)(runs % 2);
+    ct_perm_configure(rounds ? ct_perm_mix(seed ^ ct_perm_mix(rounds)) : seed, reverse);
+
+    if(f) {
+        rewind(f);
+        if(ftruncate(fileno(f), 0) == 0) {
+            runs++;
+            fprintf(f, "runs %lu\n", runs);
+            fprintf(f, "seed %lu\n", seed);
+            /* how to repeat this run with $CT_RAND_SEED and $CT_RAND_REV */
+            fprintf(f, "last_seed %lu\n", g_ct_perm_seed);
+            fprintf(f, "last_reverse %d\n", reverse);
+        }
+        fclose(f); /* and unlock */
+    }
+}
+
+void ct_perm_init(ct_perm* p, int n, ct_perm_scope* scope) {
+    unsigned long state;
+    int k;
+    if(scope) {
+        state = ct_perm_mix(scope->key ^ ct_perm_mix(scope->loops++));
+    }
+    else {
+        unsigned long loop = ATOMIC_FETCH_THEN_INCR(&g_ct_perm_loops, 1);
+        state = ct_perm_mix(g_ct_perm_seed ^ ct_perm_mix(loop));
+    }
+    p->key = state;
+    p->n = n;
+    p->reverse = g_ct_perm_reverse;
+    p->half_bits = 1;
+    while(p->half_bits < 16 && (1UL << (2*p->half_bits)) < (unsigned long)n) {
+        p->half_bits++;
+    }
+    p->half_mask = (1UL << p->half_bits) - 1;
+    for(k=0; k<CT_PERM_ROUNDS; ++k) {
+        state = ct_perm_mix(state + 0x9e3779b9UL);
+        p->keys[k] = state;
+    }
+}
+
+void ct_perm_enter(ct_perm_scope* scope, const ct_perm* p, int ind) {
+    scope->key = ct_perm_mix(p->key + ct_perm_mix((unsigned long)ind ^ 0x85ebca6bUL));
+    scope->loops = 0;
+}
+
+/* a bijection on [0, 4^half_bits) */
+unsigned long ct_perm_feistel(const ct_perm* p, unsigned long x) {
+    unsigned long left = x >> p->half_bits, right = x & p->half_mask;
+    int k;
+    for(k=0; k<CT_PERM_ROUNDS; ++k) {
+        unsigned long next = (left ^ ct_perm_mix(right ^ p->keys[k])) & p->half_mask;
+        left = right;
+        right = next;
+    }
+    return (left << p->half_bits) | right;
+}
+
+int ct_perm_at(const ct_perm* p, int i) {
+    unsigned long x = (unsigned long)(p->reverse ? p->n - 1 - i : i);
+    /* the domain is less than 4 times n, so this takes under 4 steps on average;
+       it terminates because x is on a cycle of the bijection containing a value in [0,n) */
+    do {
+        x = ct_perm_feistel(p, x);
+    } while(x >= (unsigned long)p->n);
+    return (int)x;
+}
@@ -0,0 +1,61 @@
+/*
+ * Index permutations for the order-randomizing schedulers (shuffle, pshuffle
+ * and valgrind.) A permutation of [0,n) takes no storage: the i-th index is
+ * computed on demand by a Feistel network over the smallest power-of-4 domain
+ * holding n, "cycle-walking" the values that fall outside [0,n) until they
+ * land inside it. Each loop gets its own keys, derived from $CT_RAND_SEED and
+ * the loop's sequence number among the top-level loops - or, for a nested loop,
+ * from the key of the loop it's nested in, the index it's nested in, and its
+ * sequence number within that index. So there's no shared generator state, and
+ * the keys don't depend on the order in which parallel indexes start loops.
+ */
+#ifndef CT_PERM_H_
+#define CT_PERM_H_
+
+#define CT_PERM_ROUNDS 4
+
+typedef struct {
+    int n;
+    int reverse; /* iterate the permutation backwards ($CT_RAND_REV) */
+    int half_bits; /* the Feistel network works on values of 2*half_bits bits */
+    unsigned long half_mask;
+    unsigned long key; /* the loop's, which its keys and nested loops' keys are derived from */
+    unsigned long keys[CT_PERM_ROUNDS];
+} ct_perm;
+
+/* the loops started while running an index */
+typedef struct {
+    unsigned long key;
+    unsigned long loops; /* loops started in the index so far */
+} ct_perm_scope;
+
+/* the scope of the index the serial schedulers are running (0 at the top level);
+   parallel schedulers keep the scope of every thread's index */
+extern ct_perm_scope* g_ct_perm_scope;
+
+/* sets the seed and the direction of the permutations made from now on,
+   and restarts the sequence of loops they're derived from. */
+void ct_perm_configure(unsigned long seed, int reverse);
+
+/* schedule exploration ($CT_EXPLORE): rather than each run using the seed it's given,
+   successive runs take their seed and direction from state_file, and update it. a
+   run is either the permutations of a new seed, or the reverse of the previous run's -
+   together, they run every pair of indexes of every loop in both orders, which
+   independent random seeds only do with high probability after ~2*log2(n) runs.
+   with both_directions (a scheduler running both orders in one run), every run
+   takes a new seed. configures the permutations as ct_perm_configure does.
+   the file is locked while it's updated, so runs started at once take turns. */
+void ct_perm_explore(const char* state_file, unsigned long seed, int both_directions);
+
+/* a permutation of [0,n) for the next loop started in scope (0: at the top level);
+   for a given seed, the k-th loop started in the same index of the same loop
+   always gets the same permutation. */
+void ct_perm_init(ct_perm* p, int n, ct_perm_scope* scope);
+
+/* the scope of the loops nested in p's index ind */
+void ct_perm_enter(ct_perm_scope* scope, const ct_perm* p, int ind);
+
+/* the index at position i (0 <= i < n) */
+int ct_perm_at(const ct_perm* p, int i);
+
+#endif /* CT_PERM_H_ */
@@ -1,141 +1,526 @@
+#define _POSIX_C_SOURCE 200112L /* clock_gettime, pthread_cond_timedwait */
 #include "imp.h"
 #include "nprocs.h"
 #include "lock_based_queue.h"
+#include "stats.h"
+#include "trace.h"
+#include "perm.h"
 
 #ifdef CT_PTHREADS
 
 #include <stdio.h>
+#include <string.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stdlib.h>
+#include <time.h>
+#include <errno.h>
 #include "atomic.h"
 
+/* the idle policy: a worker finding the queue empty spins for spin_sec, then
+   yields a few times, then parks in pthread_cond_wait. with $CT_SPIN_USEC=adaptive,
+   each worker spins for twice the time it typically waits for work - as long as
+   that's under CT_SPIN_ADAPTIVE_MAX_SEC; with loops coming in farther apart
+   than that, spinning just burns CPU time, so it parks right away. */
+#define CT_SPIN_ADAPTIVE (-1)
+#define CT_SPIN_ADAPTIVE_MAX_SEC 200e-6
+#define CT_SPIN_YIELDS 16
+#define CT_SPIN_PAUSES 64 /* pauses between looking at the clock */
+
+/* a thread waiting for its loop to complete, with nothing to steal, spins that
+   long before it blocks - the last indexes in flight often complete by then. */
+#define CT_WAIT_SPIN_SEC 20e-6
+/* the time a worker works on a loop before moving on to the next queued one */
+#define CT_SLICE_SEC 100e-6
+
+/* ct_set_num_threads can grow a pool up to this many threads (not counting the
+   thread submitting the loops), or up to its initial size if that's larger. */
+#define CT_MAX_THREADS 256
+
+typedef struct ct_pthread_pool_ ct_pthread_pool;
+
+/* a thread doing a pool's work: one of the pool's threads, or a thread outside
+   the pool calling ct_for - those all share worker 0. several of them may submit
+   loops at once, so each counts into its own ct_stats while its loop runs, and
+   adds them to worker 0's entry under stats_mutex when the loop is done. */
 typedef struct {
+    ct_pthread_pool* pool;
+    int id; /* our entry in the pool's stats */
+    pthread_t thread;
+    int started; /* thread was created, and wasn't joined yet */
+    int live; /* the thread is running our worker loop; changed with the pool's mutex locked */
+} ct_pthread_worker;
+
+struct ct_pthread_pool_ {
     pthread_cond_t cond;
     pthread_mutex_t mutex;
-    ct_locked_queue q;
-    pthread_t* threads;
-    int num_threads;
-    volatile int num_initialized;
-    int terminate;
-} ct_pthread_pool;
+    pthread_mutex_t stats_mutex; /* guards worker 0's stats */
+    ct_locked_queue q[CT_NUM_PRIOS]; /* a queue per priority class */
+    ct_pthread_worker* workers; /* capacity+1 - workers[0] is for the threads outside the pool */
+    int capacity;
+    /* workers 1..num_threads should be running; those above it exit when they're next
+       idle, and those below it which exited after idle_timeout_sec are re-spawned
+       by the next loop submitted to the pool. */
+    volatile int num_threads;
+    volatile int num_live; /* workers running */
+    double idle_timeout_sec; /* 0: never */
+    volatile int terminate;
+    volatile int num_parked; /* workers in (or about to enter) pthread_cond_wait */
+    double spin_sec; /* or CT_SPIN_ADAPTIVE */
+    ct_stats_table stats;
+};
 
 /* TODO: allocate dynamically with an option to set size from environment? */
 #define MAX_ITEMS (8*1024)
-ct_work_item* g_ct_pthread_items[MAX_ITEMS];
+ct_work_item* g_ct_pthread_items[CT_NUM_PRIOS][MAX_ITEMS];
 
-ct_pthread_pool g_ct_pthread_pool = {
-    PTHREAD_COND_INITIALIZER, PTHREAD_MUTEX_INITIALIZER,
-    CT_LOCKED_QUEUE_INITIALIZER,
-    0, 0, 0, 0
-};
+/* the default pool, used by threads which didn't enter another one (ct_pool_for & co) */
+ct_pthread_pool g_ct_pthread_pool;
+/* the calling thread's ct_pthread_worker; unset means worker 0 of the default pool */
+pthread_key_t g_ct_pthread_key;
+/* the priority of the item the calling thread is working on, plus 1 (unset - 0 -
+   outside any item); loops submitted with CT_PRIO_DEFAULT from its indexes get it */
+pthread_key_t g_ct_pthread_prio_key;
+/* $CT_SPIN_USEC and $CT_IDLE_TIMEOUT_MSEC, for the pools created after ct_init */
+double g_ct_pthread_spin_sec;
+double g_ct_pthread_idle_timeout_sec;
+
+ct_pthread_worker* ct_pthreads_current(void) {
+    ct_pthread_worker* worker = (ct_pthread_worker*)pthread_getspecific(g_ct_pthread_key);
+    return worker ? worker : &g_ct_pthread_pool.workers[0];
+}
+
+ct_stats* ct_pthreads_stats(ct_pthread_worker* worker) {
+    return ct_stats_of(&worker->pool->stats, worker->id);
+}
+
+int ct_pthreads_dequeue_work(ct_pthread_pool* pool, int min_priority, ct_stats* stats, int trace_kind,
+                             volatile int* until_done);
+void ct_pthreads_signal(ct_pthread_pool* pool, int num_workers);
+
+/* when the pool grew since the item was queued, queues entries for the added
+   threads (as many as there are indexes left.) whoever sees the growth first does
+   it; the caller holds a reference to the item, so it can't go away meanwhile. */
+void ct_pthreads_spread(ct_pthread_pool* pool, ct_work_item* item, int priority) {
+    int queued_for = item->queued_for, num_threads = pool->num_threads, extra, left;
+    if(num_threads <= queued_for ||
+       ATOMIC_COMPARE_AND_SWAP(&item->queued_for, queued_for, num_threads) != queued_for) {
+        return;
+    }
+    extra = num_threads - queued_for;
+    left = item->n - item->next_ind;
+    if(extra > left) {
+        extra = left;
+    }
+    if(extra <= 0) {
+        return;
+    }
+    ATOMIC_FETCH_THEN_INCR(&item->ref_cnt, extra);
+    if(ct_locked_enqueue(&pool->q[priority], item, extra)) {
+        ct_pthreads_signal(pool, extra);
+    }
+    else { /* the queue is full; the threads we have will do */
+        ATOMIC_FETCH_THEN_DECR(&item->ref_cnt, extra);
+    }
+}
 
-void ct_pthreads_dequeue_work(ct_locked_queue* q) {
+/* works on an item of the given priority until all of its indexes are claimed
+   (returning 1), or until slice_sec pass (0: no limit) with indexes left to claim
+   (returning 0.) items are preempted when work of the next priority class is
+   queued; we run that work first, and then get back to the item. */
+int ct_pthreads_work(ct_pthread_pool* pool, ct_work_item* item, int priority, ct_stats* stats, int trace_kind,
+                     double slice_sec) {
+    double deadline = slice_sec > 0 ? ct_seconds() + slice_sec : 0;
+    void* enclosing = pthread_getspecific(g_ct_pthread_prio_key);
+    int claimed = 1;
+    stats->items++;
+    pthread_setspecific(g_ct_pthread_prio_key, (void*)(long)(priority+1));
+    while(1) {
+        double start = ct_seconds(), end;
+        int done = ct_work(item, deadline);
+        end = ct_seconds();
+        stats->indexes += done;
+        stats->busy_sec += end - start;
+        if(g_ct_trace) {
+            ct_trace_event(trace_kind, start, end, done);
+        }
+        if(item->next_ind >= item->n) {
+            break;
+        }
+        ct_pthreads_spread(pool, item, priority);
+        if(deadline && end >= deadline) {
+            claimed = 0;
+            break;
+        }
+        ct_pthreads_dequeue_work(pool, priority+1, stats, trace_kind, 0);
+    }
+    pthread_setspecific(g_ct_pthread_prio_key, enclosing);
+    return claimed;
+}
+
+/* dequeues items of min_priority and up, highest first, until there are none left
+   or *until_done reaches 0 (if until_done isn't 0); returns the number of items worked on.
+   trace_kind tells whether we're a worker woken up to do the work (CT_TRACE_CHUNK) or
+   we're waiting for a loop we spawned and are "stealing" someone else's work in the
+   meanwhile (CT_TRACE_STEAL.)
+
+   for fairness between loops submitted by different threads, we work on an item for
+   CT_SLICE_SEC at a time; then, if other items are queued, we put it back at the end
+   of the queue and move on. the threads submitting the loops keep working on their own
+   loops all the time, so every loop progresses even when the pool is busy. a thread
+   stealing work while waiting for its own loop puts the stolen item back as soon as
+   its loop is done, so it's never delayed by more than a slice. */
+int ct_pthreads_dequeue_work(ct_pthread_pool* pool, int min_priority, ct_stats* stats, int trace_kind,
+                             volatile int* until_done) {
     ct_work_item* item;
+    int items = 0;
     do {
-        item = ct_locked_dequeue(q);
-        if(item) {
-            ct_work(item);
-            if(ATOMIC_FETCH_THEN_DECR(&item->ref_cnt, 1) == 1) {
-                free(item);
+        int priority, claimed, requeued = 0;
+        item = 0;
+        for(priority=CT_NUM_PRIOS-1; priority>=min_priority && !item; --priority) {
+            item = ct_locked_dequeue(&pool->q[priority]);
+        }
+        if(!item) {
+            break;
+        }
+        ++priority; /* the loop decremented it past the queue we dequeued from */
+        if(pool->q[priority].size > 0) {
+            ct_pthreads_signal(pool, 1); /* pass the wakeup on to whoever will take the next entry */
+        }
+        claimed = ct_pthreads_work(pool, item, priority, stats, trace_kind, CT_SLICE_SEC);
+        while(!claimed) {
+            int waited_for = until_done && *until_done <= 0;
+            if((waited_for || pool->q[priority].size > 0) && ct_locked_enqueue(&pool->q[priority], item, 1)) {
+                requeued = 1; /* the queue now holds our reference */
+                if(waited_for) {
+                    ct_pthreads_signal(pool, 1);
+                }
+                break;
             }
+            claimed = ct_pthreads_work(pool, item, priority, stats, trace_kind, CT_SLICE_SEC);
         }
-    } while(item);
+        items++;
+        if(!requeued && ATOMIC_FETCH_THEN_DECR(&item->ref_cnt, 1) == 1) {
+            free(item);
+        }
+    } while(!(until_done && *until_done <= 0));
+    return items;
 }
 
-void* ct_pthreads_worker(void* arg) {
-    int id = (int)(size_t)arg;
-    ct_pthread_pool* pool = &g_ct_pthread_pool;
+int ct_pthreads_has_work(ct_pthread_pool* pool) {
+    int priority;
+    for(priority=0; priority<CT_NUM_PRIOS; ++priority) {
+        if(pool->q[priority].size > 0) {
+            return 1;
+        }
+    }
+    return pool->terminate;
+}
 
-    (void)id; /* TODO: use this to implement a ct_curr_thread() function
-                 (thread-local storage doesn't require an ID number - there are pthread keys for that. */
+/* there might be work in the queue, or we're to exit */
+int ct_pthreads_wakeup(ct_pthread_worker* worker) {
+    return ct_pthreads_has_work(worker->pool) || worker->id > worker->pool->num_threads;
+}
 
+/* returns 1 once there might be work in the queue, or 0 if the worker should exit:
+   when the pool is terminating or shrank below it, or after it was parked for the
+   pool's idle timeout. */
+int ct_pthreads_idle(ct_pthread_worker* worker, double spin_sec) {
+    ct_pthread_pool* pool = worker->pool;
+    int i, timed_out = 0, keep;
+    if(spin_sec > 0) {
+        double start = ct_seconds();
+        while(!ct_pthreads_wakeup(worker) && ct_seconds() - start < spin_sec) {
+            for(i=0; i<CT_SPIN_PAUSES && !ct_pthreads_wakeup(worker); ++i) {
+                CPU_PAUSE();
+            }
+        }
+        for(i=0; i<CT_SPIN_YIELDS && !ct_pthreads_wakeup(worker); ++i) {
+            sched_yield();
+        }
+    }
     pthread_mutex_lock(&pool->mutex);
-    ++pool->num_initialized; /* this signals the master that it should
-                                sync with us by locking and unlocking
-                                the cond var mutex */
-    while(!pool->terminate) {
-        /* wait unlocks the mutex while it waits... */
-        pthread_cond_wait(&pool->cond, &pool->mutex);
-        /* ...and locks it back before it returns. */
-
+    pool->num_parked++;
+    /* ct_pthreads_signal looks at num_parked after enqueueing; we look at the queue
+       after announcing that we're parking - so either we see the work, or it sees us. */
+    ATOMIC_MEMORY_BARRIER();
+    if(!ct_pthreads_wakeup(worker)) {
         /* we're OK with spurious wakeups - ct_locked_dequeue will simply return 0 */
-        pthread_mutex_unlock(&pool->mutex);
-        ct_pthreads_dequeue_work(&pool->q);
-        pthread_mutex_lock(&pool->mutex);
+        if(pool->idle_timeout_sec > 0) {
+            struct timespec deadline;
+            double sec;
+            clock_gettime(CLOCK_REALTIME, &deadline);
+            sec = deadline.tv_nsec*1e-9 + pool->idle_timeout_sec;
+            deadline.tv_sec += (time_t)sec;
+            deadline.tv_nsec = (long)((sec - (time_t)sec)*1e9);
+            /* work enqueued just as we timed out is still ours to do */
+            timed_out = pthread_cond_timedwait(&pool->cond, &pool->mutex, &deadline) == ETIMEDOUT &&
+                        !ct_pthreads_has_work(pool);
+        }
+        else {
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        }
+    }
+    pool->num_parked--;
+    keep = !pool->terminate && !timed_out && worker->id <= pool->num_threads;
+    if(!keep) {
+        /* with the mutex locked, so that ct_pthreads_spawn either sees us live and
+           leaves us be, or sees us gone and starts a new thread for our slot */
+        worker->live = 0;
+        pool->num_live--;
     }
     pthread_mutex_unlock(&pool->mutex);
+    return keep;
+}
+
+void* ct_pthreads_worker(void* arg) {
+    ct_pthread_worker* worker = (ct_pthread_worker*)arg;
+    ct_pthread_pool* pool = worker->pool;
+    ct_stats* stats = ct_pthreads_stats(worker);
+    double wait_sec = CT_SPIN_ADAPTIVE_MAX_SEC/2; /* a moving average of the time spent waiting for work */
+
+    pthread_setspecific(g_ct_pthread_key, worker);
+
+    while(1) {
+        double spin_sec = pool->spin_sec, start = ct_seconds(), end;
+        int keep;
+        if(spin_sec == CT_SPIN_ADAPTIVE) {
+            spin_sec = wait_sec*2 <= CT_SPIN_ADAPTIVE_MAX_SEC ? wait_sec*2 : 0;
+        }
+        keep = ct_pthreads_idle(worker, spin_sec);
+        end = ct_seconds();
+        stats->idle_sec += end - start;
+        if(g_ct_trace) {
+            ct_trace_event(CT_TRACE_IDLE, start, end, 0);
+        }
+        if(!keep) {
+            break;
+        }
+
+        if(ct_pthreads_dequeue_work(pool, CT_PRIO_NORMAL, stats, CT_TRACE_CHUNK, 0) == 0) {
+            stats->empty_wakeups++;
+        }
+        else {
+            wait_sec += (end - start - wait_sec) / 4;
+        }
+    }
     return 0;
 }
 
-void ct_pthreads_broadcast(void) {
-    ct_pthread_pool* pool = &g_ct_pthread_pool;
+/* wake up to num_workers parked workers after enqueueing work; the spinning ones
+   will see it by themselves. with many threads submitting loops, waking everyone
+   up for every loop would have them all fight over the queue. */
+void ct_pthreads_signal(ct_pthread_pool* pool, int num_workers) {
+    ATOMIC_MEMORY_BARRIER();
+    if(pool->num_parked > 0) {
+        pthread_mutex_lock(&pool->mutex);
+        if(num_workers >= pool->num_parked) {
+            pthread_cond_broadcast(&pool->cond);
+        }
+        else {
+            while(num_workers--) {
+                pthread_cond_signal(&pool->cond);
+            }
+        }
+        pthread_mutex_unlock(&pool->mutex);
+    }
+}
+
+/* waits for the item's indexes running elsewhere to complete */
+void ct_pthreads_wait(ct_pthread_pool* pool, ct_work_item* item, int priority, ct_stats* stats) {
+    double start = ct_seconds();
+    int i;
+    while(item->to_do > 0) {
+        if(ct_pthreads_dequeue_work(pool, priority, stats, CT_TRACE_STEAL, &item->to_do)) {
+            start = ct_seconds();
+            continue;
+        }
+        /* nothing to steal - all our indexes are in flight */
+        for(i=0; i<CT_SPIN_PAUSES; ++i) {
+            CPU_PAUSE();
+        }
+        if(ct_seconds() - start >= CT_WAIT_SPIN_SEC) {
+            ct_work_wait(item);
+        }
+    }
+}
+
+/* starts threads for the workers 1..num_threads which have none running; called
+   with the pool's mutex locked. the thread of a worker which exited is joined first
+   - by now, it's done with the pool, or just about to return. */
+void ct_pthreads_spawn(ct_pthread_pool* pool) {
+    int i;
+    for(i=1; i<=pool->num_threads; ++i) {
+        ct_pthread_worker* worker = &pool->workers[i];
+        if(worker->live) {
+            continue;
+        }
+        if(worker->started) {
+            pthread_join(worker->thread, 0);
+            worker->started = 0;
+        }
+        worker->live = 1;
+        /* threads are joinable by default, which is what we need */
+        if(pthread_create(&worker->thread, 0, ct_pthreads_worker, worker) != 0) {
+            worker->live = 0; /* we'll try again with the next loop */
+            break;
+        }
+        worker->started = 1;
+        pool->num_live++;
+    }
+    /* the stats of workers which exited stay in the table, so it only grows */
+    if(pool->num_threads+1 > pool->stats.num_workers) {
+        ct_stats_table_set_num_workers(&pool->stats, pool->num_threads+1);
+    }
+}
+
+/* the number of worker threads from the total number, including the submitting thread */
+int ct_pthreads_num_workers(int num_threads) {
+    if(num_threads <= 0) {
+        num_threads = ct_nprocs();
+    }
+    return num_threads - 1;
+}
+
+void ct_pthreads_resize(ct_pthread_pool* pool, int num_threads) {
     pthread_mutex_lock(&pool->mutex);
+    pool->num_threads = num_threads < pool->capacity ? num_threads : pool->capacity;
+    pool->spin_sec = g_ct_pthread_spin_sec;
+    if(pool->spin_sec == CT_SPIN_ADAPTIVE && pool->num_threads >= ct_nprocs()) {
+        pool->spin_sec = 0; /* with more threads than cores, a spinning worker takes a core from a working one */
+    }
+    ct_pthreads_spawn(pool);
+    /* workers beyond the new size exit when they see it; wake up those which are parked */
     pthread_cond_broadcast(&pool->cond);
     pthread_mutex_unlock(&pool->mutex);
 }
 
-void ct_pthreads_init(const ct_env_var* env) {
-    int num_threads = atoi(ct_getenv(env, "CT_THREADS", "0"));
-    ct_pthread_pool* pool = &g_ct_pthread_pool;
-    pthread_attr_t attr;
+/* num_threads is the total number, including the thread submitting the loops;
+   items has room for MAX_ITEMS per priority class. */
+void ct_pthreads_start(ct_pthread_pool* pool, int num_threads, ct_work_item** items, const char* stats_file) {
     int i;
     /* TODO: we might want a way to get the threads for the pool from the outside. */
-    if(num_threads == 0) {
-        num_threads = ct_nprocs();
-    }
     /* here, num_threads means "number of slaves", whereas $CT_THREADS is the total number,
        including the master */
-    num_threads--;
+    num_threads = ct_pthreads_num_workers(num_threads);
+    pool->capacity = num_threads > CT_MAX_THREADS ? num_threads : CT_MAX_THREADS;
 
     pthread_cond_init(&pool->cond, 0);
     pthread_mutex_init(&pool->mutex, 0);
-    ct_locked_queue_init(&pool->q, g_ct_pthread_items, MAX_ITEMS);
-    pool->threads = (pthread_t*)malloc(sizeof(pthread_t)*num_threads);
-    pool->num_threads = num_threads;
-    /* For portability, explicitly create threads in a joinable state.
-       -- https://computing.llnl.gov/tutorials/pthreads/#ConditionVariables */
-    pthread_attr_init(&attr);
-    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_JOINABLE);
-    for(i=0; i<num_threads; ++i) {
-        pthread_create(&pool->threads[i], &attr, ct_pthreads_worker, (void*)(size_t)i);
-        /* wait for the spawned thread to lock the cond var mutex */
-        while(pool->num_initialized == i);
-        /* now make sure it /unlocked/ the mutex - that is, that it entered the wait */
-        pthread_mutex_lock(&pool->mutex);
-        pthread_mutex_unlock(&pool->mutex);
+    pthread_mutex_init(&pool->stats_mutex, 0);
+    ct_stats_table_init(&pool->stats, pool->capacity+1, stats_file);
+    ct_stats_table_set_num_workers(&pool->stats, 1);
+    for(i=0; i<CT_NUM_PRIOS; ++i) {
+        ct_locked_queue_init(&pool->q[i], items + i*MAX_ITEMS, MAX_ITEMS);
+    }
+    /* the workers never move, since their threads point at them */
+    pool->workers = (ct_pthread_worker*)malloc(sizeof(ct_pthread_worker)*(pool->capacity+1));
+    pool->num_threads = 0;
+    pool->num_live = 0;
+    pool->idle_timeout_sec = g_ct_pthread_idle_timeout_sec;
+    pool->terminate = 0;
+    pool->num_parked = 0;
+    /* the threads outside the pool are worker 0, so the pool's threads are numbered from 1 */
+    for(i=0; i<=pool->capacity; ++i) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        pool->workers[i].started = 0;
+        pool->workers[i].live = 0;
     }
-    pthread_attr_destroy(&attr);
+    ct_pthreads_resize(pool, num_threads);
 }
 
-void ct_pthreads_fini(void) {
-    ct_pthread_pool* pool = &g_ct_pthread_pool;
+void ct_pthreads_stop(ct_pthread_pool* pool) {
     int i;
+    pthread_mutex_lock(&pool->mutex);
     pool->terminate = 1;
-    ct_pthreads_broadcast();
-    for(i=0; i<pool->num_threads; ++i) {
-        pthread_join(pool->threads[i], 0);
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for(i=1; i<=pool->capacity; ++i) {
+        if(pool->workers[i].started) {
+            pthread_join(pool->workers[i].thread, 0);
+        }
     }
     pthread_mutex_destroy(&pool->mutex);
+    pthread_mutex_destroy(&pool->stats_mutex);
     pthread_cond_destroy(&pool->cond);
-    free(pool->threads);
+    ct_stats_table_fini(&pool->stats);
+    free(pool->workers);
 }
 
-void ct_pthreads_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
-    ct_pthread_pool* pool = &g_ct_pthread_pool;
-    ct_locked_queue* q = &pool->q;
+void ct_pthreads_init(const ct_env_var* env) {
+    const char* spin_usec = ct_getenv(env, "CT_SPIN_USEC", "0");
+    g_ct_pthread_spin_sec = strcmp(spin_usec, "adaptive") == 0 ? CT_SPIN_ADAPTIVE : atof(spin_usec) * 1e-6;
+    g_ct_pthread_idle_timeout_sec = atof(ct_getenv(env, "CT_IDLE_TIMEOUT_MSEC", "0")) * 1e-3;
+    pthread_key_create(&g_ct_pthread_key, 0);
+    pthread_key_create(&g_ct_pthread_prio_key, 0);
+    ct_pthreads_start(&g_ct_pthread_pool, atoi(ct_getenv(env, "CT_THREADS", "0")), &g_ct_pthread_items[0][0],
+                      ct_getenv(env, "CT_STATS_FILE", 0));
+}
+
+void ct_pthreads_fini(void) {
+    ct_pthreads_stop(&g_ct_pthread_pool);
+    pthread_key_delete(g_ct_pthread_key);
+    pthread_key_delete(g_ct_pthread_prio_key);
+}
+
+void ct_pthreads_pool_init(ct_pool* p, int num_threads) {
+    ct_pthread_pool* pool = (ct_pthread_pool*)malloc(sizeof(ct_pthread_pool));
+    ct_work_item** items = (ct_work_item**)malloc(sizeof(ct_work_item*)*CT_NUM_PRIOS*MAX_ITEMS);
+    ct_pthreads_start(pool, num_threads, items, 0);
+    p->sched_data = pool;
+}
+
+void ct_pthreads_pool_fini(ct_pool* p) {
+    ct_pthread_pool* pool = (ct_pthread_pool*)p->sched_data;
+    ct_pthreads_stop(pool);
+    free(pool->q[0].work_items);
+    free(pool);
+}
+
+void* ct_pthreads_pool_enter(ct_pool* p) {
+    ct_pthread_pool* pool = (ct_pthread_pool*)p->sched_data;
+    ct_pthread_worker* prev = (ct_pthread_worker*)pthread_getspecific(g_ct_pthread_key);
+    if(!prev || prev->pool != pool) { /* the pool's own threads stay who they are */
+        pthread_setspecific(g_ct_pthread_key, &pool->workers[0]);
+    }
+    return prev;
+}
+
+void ct_pthreads_pool_leave(void* prev) {
+    pthread_setspecific(g_ct_pthread_key, prev);
+}
+
+/* resizes the calling thread's pool */
+void ct_pthreads_set_num_threads(int num_threads) {
+    ct_pthreads_resize(ct_pthreads_current()->pool, ct_pthreads_num_workers(num_threads));
+}
+
+void ct_pthreads_submit(ct_pthread_pool* pool, ct_stats* stats, int n, ct_ind_func f, void* context,
+                        ct_canceller* c, int priority) {
+    ct_locked_queue* q = &pool->q[priority];
     ct_work_item* item;
-    int reps;
+    int reps, num_threads;
+
+    /* re-spawn the workers which exited after idling for too long */
+    if(pool->num_live < pool->num_threads) {
+        pthread_mutex_lock(&pool->mutex);
+        ct_pthreads_spawn(pool);
+        pthread_mutex_unlock(&pool->mutex);
+    }
 
     while(q->size == q->capacity) {
         --n;
         f(n, context);
+        stats->queue_full_indexes++;
         if(n == 0) { /* we're done while waiting... */
             return;
         }
     }
 
     item = (ct_work_item*)malloc(sizeof(ct_work_item));
-    reps = n < pool->num_threads ? n : pool->num_threads;
+    num_threads = pool->num_threads;
+    reps = n < num_threads ? n : num_threads;
 
     item->n = n;
     item->to_do = n;
@@ -144,11 +529,16 @@ void ct_pthreads_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
     item->context = context;
     item->ref_cnt = reps + 1;
     item->canceller = c;
+    item->preempt = priority+1 < CT_NUM_PRIOS ? &pool->q[priority+1].size : 0;
+    item->pool_size = &pool->num_threads;
+    item->queued_for = num_threads;
+    item->waiter = 0;
 
     /* try to enqueue the item, and do some work while that fails */
     while(!ct_locked_enqueue(q, item, reps)) {
         --n;
         f(n, context);
+        stats->queue_full_indexes++;
         if(n == 0) { /* we're done while waiting... */
             free(item);
             return;
@@ -157,17 +547,25 @@ void ct_pthreads_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
         item->to_do = n;
     }
 
-    /* everybody wake up! we have work for you. */
-    ct_pthreads_broadcast();
+    if((unsigned long)q->size > stats->peak_queue_depth) {
+        stats->peak_queue_depth = q->size;
+    }
+
+    /* wake up as many workers as there are queue entries */
+    ct_pthreads_signal(pool, reps);
 
     /* let's do our share: */
-    ct_work(item);
+    ct_pthreads_work(pool, item, priority, stats, CT_TRACE_CHUNK, 0);
 
     /* do work from the queue until the item is done (we may be out of indexes
        but it doesn't mean everyone else who's yanked some indexes is done;
-       item->to_do reaching 0 will tell us they're done.) */
-    while(item->to_do > 0) {
-        ct_pthreads_dequeue_work(&pool->q);
+       item->to_do reaching 0 will tell us they're done.) we only take work
+       of our loop's priority and up - a long lower-priority index would delay us. */
+    if(item->to_do > 0) {
+        double busy = stats->busy_sec, start = ct_seconds();
+        ct_pthreads_wait(pool, item, priority, stats);
+        /* time spent waiting rather than working on the queued items */
+        stats->idle_sec += (ct_seconds() - start) - (stats->busy_sec - busy);
     }
 
     item->canceller = 0; /* the canceller may be freed after we quit, so it shouldn't be accessed any more */
@@ -177,17 +575,128 @@ void ct_pthreads_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
     }
 }
 
+/* the calling thread's pool size, counting the submitting thread */
+int ct_pthreads_num_threads(void) {
+    return ct_pthreads_current()->pool->num_threads + 1;
+}
+
+/* the loop goes to the calling thread's pool - the pool it belongs to, or the one it entered */
+void ct_pthreads_for_prio(int n, ct_ind_func f, void* context, ct_canceller* c, int priority) {
+    ct_pthread_worker* worker = ct_pthreads_current();
+    ct_pthread_pool* pool = worker->pool;
+    ct_stats own;
+    if(priority == CT_PRIO_DEFAULT) {
+        priority = (int)(long)pthread_getspecific(g_ct_pthread_prio_key) - 1;
+        if(priority < CT_PRIO_NORMAL) {
+            priority = CT_PRIO_NORMAL;
+        }
+    }
+    if(worker->id != 0) {
+        ct_pthreads_submit(pool, ct_pthreads_stats(worker), n, f, context, c, priority);
+        return;
+    }
+    memset(&own, 0, sizeof own);
+    ct_pthreads_submit(pool, &own, n, f, context, c, priority);
+    pthread_mutex_lock(&pool->stats_mutex);
+    ct_stats_add(ct_pthreads_stats(worker), &own);
+    pthread_mutex_unlock(&pool->stats_mutex);
+}
+
+void ct_pthreads_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
+    ct_pthreads_for_prio(n, f, context, c, CT_PRIO_DEFAULT);
+}
+
+int ct_pthreads_get_stats(ct_stats* total, ct_stats* per_worker, int max_workers) {
+    return ct_stats_table_get(&ct_pthreads_current()->pool->stats, total, per_worker, max_workers);
+}
+
+/* pshuffle: the pthreads pool, claiming indexes in the shuffle scheduler's order.
+   a loop's indexes are permuted as under $CT_SCHED=shuffle (honoring $CT_RAND_SEED
+   and $CT_RAND_REV), and the pool's threads claim position i of the permutation
+   where pthreads would claim index i - so the order differs from the usual
+   ascending one, but the indexes run in parallel. every thread keeps the
+   ct_perm_scope of the index it's running, so that a nested loop's permutation
+   doesn't depend on when other threads started theirs. */
+void ct_shuffle_init(const ct_env_var* env);
+
+typedef struct {
+    ct_perm perm;
+    ct_ind_func f;
+    void* context;
+} ct_pshuffle_loop;
+
+pthread_key_t g_ct_pshuffle_scope_key; /* the calling thread's ct_perm_scope, 0 outside loops */
+
+void ct_pshuffle_index(int ind, void* context) {
+    ct_pshuffle_loop* loop = (ct_pshuffle_loop*)context;
+    void* enclosing = pthread_getspecific(g_ct_pshuffle_scope_key);
+    ct_perm_scope scope;
+    ind = ct_perm_at(&loop->perm, ind);
+    ct_perm_enter(&scope, &loop->perm, ind);
+    pthread_setspecific(g_ct_pshuffle_scope_key, &scope);
+    loop->f(ind, loop->context);
+    pthread_setspecific(g_ct_pshuffle_scope_key, enclosing);
+}
+
+void ct_pshuffle_init(const ct_env_var* env) {
+    ct_shuffle_init(env);
+    pthread_key_create(&g_ct_pshuffle_scope_key, 0);
+    ct_pthreads_init(env);
+}
+
+void ct_pshuffle_fini(void) {
+    ct_pthreads_fini();
+    pthread_key_delete(g_ct_pshuffle_scope_key);
+}
+
+void ct_pshuffle_for_prio(int n, ct_ind_func f, void* context, ct_canceller* c, int priority) {
+    ct_pshuffle_loop loop;
+    ct_perm_init(&loop.perm, n, (ct_perm_scope*)pthread_getspecific(g_ct_pshuffle_scope_key));
+    loop.f = f;
+    loop.context = context;
+    ct_pthreads_for_prio(n, ct_pshuffle_index, &loop, c, priority);
+}
+
+void ct_pshuffle_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
+    ct_pshuffle_for_prio(n, f, context, c, CT_PRIO_DEFAULT);
+}
+
 ct_imp g_ct_pthreads_imp = {
     "pthreads",
     &ct_pthreads_init,
     &ct_pthreads_fini,
     &ct_pthreads_for,
     0, 0, 0, /* cancelling functions */
+    &ct_pthreads_get_stats,
+    &ct_pthreads_for_prio,
+    &ct_pthreads_pool_init,
+    &ct_pthreads_pool_fini,
+    &ct_pthreads_pool_enter,
+    &ct_pthreads_pool_leave,
+    &ct_pthreads_set_num_threads,
+    &ct_pthreads_num_threads,
+};
+
+ct_imp g_ct_pshuffle_imp = {
+    "pshuffle",
+    &ct_pshuffle_init,
+    &ct_pshuffle_fini,
+    &ct_pshuffle_for,
+    0, 0, 0, /* cancelling functions */
+    &ct_pthreads_get_stats,
+    &ct_pshuffle_for_prio,
+    &ct_pthreads_pool_init,
+    &ct_pthreads_pool_fini,
+    &ct_pthreads_pool_enter,
+    &ct_pthreads_pool_leave,
+    &ct_pthreads_set_num_threads,
+    &ct_pthreads_num_threads,
 };
 
 #else
 
 ct_imp g_ct_pthreads_imp;
+ct_imp g_ct_pshuffle_imp;
 
 #endif
 
@@ -23,4 +23,9 @@ ct_imp g_ct_serial_imp = {
     &ct_serial_fini,
     &ct_serial_for,
     0, 0, 0, /* cancelling functions */
+    0, /* statistics */
+    0, /* priorities */
+    0, 0, 0, 0, /* pools */
+    0, /* resizing */
+    0, /* pool size */
 };
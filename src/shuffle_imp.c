@@ -1,59 +1,42 @@
 #include <stdlib.h>
 #include "imp.h"
-
-/* TODO: add a seed */
-/* TODO: use local state instead of rand()'s global state. */
-
-int g_ct_random_reverse = 0;
-
-/* based on GNU std::random_shuffle */
-void ct_random_shuffle(int* p, int n) {
-    int i;
-    for(i=1; i<n; ++i) {
-        /* swap p[i] with a random element in [0,i] */
-        int j = rand() % (i+1);
-        int tmp = p[j];
-        p[j] = p[i];
-        p[i] = tmp;
-    }
-}
-
-int* ct_rand_perm(int n) {
-    int* p = (int*)malloc(n*sizeof(int));
-    int i;
-    for(i=0; i<n; ++i) {
-        p[i] = i;
+#include "perm.h"
+
+/* both_directions is for the schedulers running each loop in both orders at once */
+void ct_shuffle_configure(const ct_env_var* env, int both_directions) {
+    unsigned long seed = strtoul(ct_getenv(env, "CT_RAND_SEED", "12345"), 0, 10);
+    const char* explore = ct_getenv(env, "CT_EXPLORE", 0);
+    if(explore) {
+        ct_perm_explore(explore, seed, both_directions);
     }
-    ct_random_shuffle(p, n);
-    if(g_ct_random_reverse) {
-        for(i=0; i<n/2; ++i) {
-            int tmp = p[i];
-            p[i] = p[n-i-1];
-            p[n-i-1] = tmp;
-        }
+    else {
+        ct_perm_configure(seed, atoi(ct_getenv(env, "CT_RAND_REV", "0")));
     }
-    return p;
 }
 
 void ct_shuffle_init(const ct_env_var* env) {
-    /* TODO: do not use rand()! */
-    srand(atoi(ct_getenv(env, "CT_RAND_SEED", "12345")));
-    g_ct_random_reverse = atoi(ct_getenv(env, "CT_RAND_REV", "0"));
+    ct_shuffle_configure(env, 0);
 }
 
 void ct_shuffle_fini(void) {
 }
 
 void ct_shuffle_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
-    int* perm = ct_rand_perm(n);
+    ct_perm perm;
+    ct_perm_scope scope, *enclosing = g_ct_perm_scope;
     int i;
+    ct_perm_init(&perm, n, enclosing);
     for(i=0; i<n; ++i) {
+        int ind;
         if(c->cancelled) {
             break;
         }
-        f(perm[i], context);
+        ind = ct_perm_at(&perm, i);
+        ct_perm_enter(&scope, &perm, ind);
+        g_ct_perm_scope = &scope;
+        f(ind, context);
     }
-    free(perm);
+    g_ct_perm_scope = enclosing;
 }
 
 ct_imp g_ct_shuffle_imp = {
@@ -62,4 +45,9 @@ ct_imp g_ct_shuffle_imp = {
     &ct_shuffle_fini,
     &ct_shuffle_for,
     0, 0, 0, /* cancelling functions */
+    0, /* statistics */
+    0, /* priorities */
+    0, 0, 0, 0, /* pools */
+    0, /* resizing */
+    0, /* pool size */
 };
@@ -0,0 +1,117 @@
+#define _POSIX_C_SOURCE 200112L /* clock_gettime, ftruncate */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "stats.h"
+#include "atomic.h"
+
+int ct_stats_map(ct_stats_table* t, const char* shared_file) {
+    size_t size = sizeof(ct_worker_stats)*(t->capacity+1); /* the header takes an entry */
+    void* p;
+    int fd = open(shared_file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if(fd < 0) {
+        return 0;
+    }
+    if(ftruncate(fd, size) != 0) {
+        close(fd);
+        return 0;
+    }
+    p = mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) {
+        return 0;
+    }
+    memset(p, 0, size);
+    t->header = (ct_stats_file_header*)p;
+    t->workers = (ct_worker_stats*)p + 1;
+    t->mapped_size = size;
+    /* write the magic number last so that a poller never sees a half-baked header */
+    t->header->num_workers = t->num_workers;
+    t->header->stride = sizeof(ct_worker_stats);
+    t->header->pid = getpid();
+    ATOMIC_MEMORY_BARRIER(); /* the stores above are visible before the magic is */
+    t->header->magic = CT_STATS_MAGIC;
+    return 1;
+}
+
+void ct_stats_table_init(ct_stats_table* t, int num_workers, const char* shared_file) {
+    if(num_workers < 1) {
+        num_workers = 1;
+    }
+    t->num_workers = num_workers;
+    t->capacity = num_workers;
+    t->header = 0;
+    t->mapped_size = 0;
+    if(shared_file && *shared_file) {
+        if(ct_stats_map(t, shared_file)) {
+            return;
+        }
+        printf("checkedthreads - WARNING: can't map $CT_STATS_FILE (%s), statistics won't be published\n",
+                shared_file);
+    }
+    t->workers = (ct_worker_stats*)calloc(num_workers, sizeof(ct_worker_stats));
+}
+
+void ct_stats_table_fini(ct_stats_table* t) {
+    if(t->header) {
+        /* the file stays around with the final counts */
+        munmap(t->header, t->mapped_size);
+        t->header = 0;
+    }
+    else {
+        free(t->workers);
+    }
+    t->workers = 0;
+    t->num_workers = 0;
+    t->capacity = 0;
+}
+
+void ct_stats_table_set_num_workers(ct_stats_table* t, int num_workers) {
+    t->num_workers = num_workers < 1 ? 1 : (num_workers > t->capacity ? t->capacity : num_workers);
+    if(t->header) {
+        t->header->num_workers = t->num_workers;
+    }
+}
+
+ct_stats* ct_stats_of(ct_stats_table* t, int worker) {
+    return &t->workers[(unsigned)worker % (unsigned)t->capacity].s;
+}
+
+int ct_stats_table_get(const ct_stats_table* t, ct_stats* total, ct_stats* per_worker, int max_workers) {
+    int i;
+    if(total) {
+        memset(total, 0, sizeof(ct_stats));
+    }
+    for(i=0; i<t->num_workers; ++i) {
+        const ct_stats* s = &t->workers[i].s;
+        if(per_worker && i < max_workers) {
+            per_worker[i] = *s;
+        }
+        if(total) {
+            ct_stats_add(total, s);
+        }
+    }
+    return t->num_workers;
+}
+
+void ct_stats_add(ct_stats* total, const ct_stats* s) {
+    total->items += s->items;
+    total->indexes += s->indexes;
+    total->busy_sec += s->busy_sec;
+    total->idle_sec += s->idle_sec;
+    total->queue_full_indexes += s->queue_full_indexes;
+    total->empty_wakeups += s->empty_wakeups;
+    if(s->peak_queue_depth > total->peak_queue_depth) {
+        total->peak_queue_depth = s->peak_queue_depth;
+    }
+}
+
+double ct_seconds(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec*1e-9;
+}
@@ -0,0 +1,55 @@
+/*
+ * Per-worker scheduler statistics. Every worker updates its own entry
+ * without synchronization; the entries are only summed when read.
+ */
+#ifndef CT_STATS_H_
+#define CT_STATS_H_
+
+#include <stddef.h>
+#include "imp.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define CT_CACHE_LINE 64
+
+/* padded so that workers updating neighboring entries don't share cache lines */
+typedef struct {
+    ct_stats s;
+    char pad[CT_CACHE_LINE - sizeof(ct_stats)%CT_CACHE_LINE];
+} ct_worker_stats;
+
+typedef struct {
+    ct_worker_stats* workers;
+    int num_workers; /* the entries in use (and reported) */
+    int capacity; /* the entries allocated */
+    ct_stats_file_header* header; /* non-0 if the entries live in a file mapping */
+    size_t mapped_size;
+} ct_stats_table;
+
+/* shared_file may be 0; otherwise, the table is placed into a file mapping
+   so that it can be polled by other processes ($CT_STATS_FILE). */
+void ct_stats_table_init(ct_stats_table* t, int num_workers, const char* shared_file);
+void ct_stats_table_fini(ct_stats_table* t);
+/* for pools growing at runtime: the table is allocated with room for the most workers
+   the pool may have, and the number of workers reported is then changed (up to that.) */
+void ct_stats_table_set_num_workers(ct_stats_table* t, int num_workers);
+
+/* worker numbers beyond the capacity are wrapped around */
+ct_stats* ct_stats_of(ct_stats_table* t, int worker);
+
+/* implements ct_get_stats for schedulers keeping a single table */
+int ct_stats_table_get(const ct_stats_table* t, ct_stats* total, ct_stats* per_worker, int max_workers);
+
+/* adds s to *total (taking the max of peak_queue_depth) */
+void ct_stats_add(ct_stats* total, const ct_stats* s);
+
+/* a monotonic clock in seconds */
+double ct_seconds(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CT_STATS_H_ */
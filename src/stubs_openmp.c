@@ -3,3 +3,4 @@
 
 ct_imp g_ct_tbb_imp;
 ct_imp g_ct_pthreads_imp;
+ct_imp g_ct_pshuffle_imp;
@@ -3,6 +3,10 @@
 #ifdef CT_TBB
 
 #include <tbb/tbb.h>
+#include "stats.h"
+#include "trace.h"
+
+ct_stats_table g_ctx_tbb_stats;
 
 void ctx_tbb_init(const ct_env_var* env) {
     int num_threads = atoi(ct_getenv(env, "CT_THREADS", "0"));
@@ -11,10 +15,13 @@ void ctx_tbb_init(const ct_env_var* env) {
     }
     else {
         static tbb::task_scheduler_init init;
+        num_threads = tbb::task_scheduler_init::default_num_threads();
     }
+    ct_stats_table_init(&g_ctx_tbb_stats, num_threads, ct_getenv(env, "CT_STATS_FILE", 0));
 }
 
 void ctx_tbb_fini(void) {
+    ct_stats_table_fini(&g_ctx_tbb_stats);
 }
 
 struct ctx_invoker {
@@ -25,15 +32,26 @@ struct ctx_invoker {
     void operator()(const tbb::blocked_range<int>& range) const {
         int begin = range.begin();
         int end = range.end();
+        ct_stats* stats = ct_stats_of(&g_ctx_tbb_stats, tbb::this_task_arena::current_thread_index());
+        double start = ct_seconds();
+        int done = 0;
+        stats->items++;
         for(int i=begin; i<end; ++i) {
             if(canceller->cancelled) {
                 tbb::task::self().cancel_group_execution();
-                return;
+                break;
             }
             else {
                 f(i, context);
+                ++done;
             }
         }
+        double finish = ct_seconds();
+        stats->indexes += done;
+        stats->busy_sec += finish - start;
+        if(g_ct_trace) {
+            ct_trace_event(CT_TRACE_CHUNK, start, finish, done);
+        }
     }
 };
 
@@ -60,12 +78,25 @@ void ctx_tbb_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
                       tbb::simple_partitioner(), ctx);
 }
 
+int ctx_tbb_get_stats(ct_stats* total, ct_stats* per_worker, int max_workers) {
+    return ct_stats_table_get(&g_ctx_tbb_stats, total, per_worker, max_workers);
+}
+
+int ctx_tbb_num_threads(void) {
+    return tbb::this_task_arena::max_concurrency();
+}
+
 ct_imp g_ct_tbb_imp = {
     "tbb",
     &ctx_tbb_init,
     &ctx_tbb_fini,
     &ctx_tbb_for,
     0, 0, 0, /* cancelling functions */
+    &ctx_tbb_get_stats,
+    0, /* priorities */
+    0, 0, 0, 0, /* pools */
+    0, /* resizing */
+    &ctx_tbb_num_threads,
 };
 
 #else
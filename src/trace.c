@@ -0,0 +1,160 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "imp.h"
+#include "trace.h"
+#include "stats.h"
+#include "atomic.h"
+
+#ifdef CT_PTHREADS
+#include <pthread.h>
+#endif
+
+/* the number of events kept per thread; older events are overwritten. */
+#define CT_TRACE_CAPACITY (64*1024)
+
+typedef struct {
+    double start;
+    double end;
+    int kind;
+    int arg;
+} ct_trace_rec;
+
+typedef struct ct_trace_buffer_ {
+    ct_trace_rec* recs;
+    volatile unsigned long pos; /* number of events ever recorded; the last CT_TRACE_CAPACITY are kept */
+    int tid;
+    struct ct_trace_buffer_* next;
+} ct_trace_buffer;
+
+int g_ct_trace = 0;
+char* g_ct_trace_file = 0;
+double g_ct_trace_start;
+ct_trace_buffer* volatile g_ct_trace_buffers = 0; /* all the buffers, pushed lock-free */
+volatile int g_ct_trace_num_buffers = 0;
+
+#ifdef CT_PTHREADS
+pthread_key_t g_ct_trace_key;
+#else
+ct_trace_buffer* g_ct_trace_shared_buffer; /* without pthreads, there's no TLS - so share a buffer */
+#endif
+
+const char* g_ct_trace_names[CT_TRACE_KINDS] = { "ct_for", "chunk", "steal", "idle" };
+
+ct_trace_buffer* ct_trace_new_buffer(void) {
+    ct_trace_buffer* b = (ct_trace_buffer*)malloc(sizeof(ct_trace_buffer));
+    ct_trace_buffer* head;
+    b->recs = (ct_trace_rec*)malloc(sizeof(ct_trace_rec)*CT_TRACE_CAPACITY);
+    b->pos = 0;
+    b->tid = ATOMIC_FETCH_THEN_INCR(&g_ct_trace_num_buffers, 1);
+    do {
+        head = g_ct_trace_buffers;
+        b->next = head;
+    } while(ATOMIC_COMPARE_AND_SWAP(&g_ct_trace_buffers, head, b) != head);
+    return b;
+}
+
+ct_trace_buffer* ct_trace_buffer_of_thread(void) {
+#ifdef CT_PTHREADS
+    ct_trace_buffer* b = (ct_trace_buffer*)pthread_getspecific(g_ct_trace_key);
+    if(!b) {
+        b = ct_trace_new_buffer();
+        pthread_setspecific(g_ct_trace_key, b);
+    }
+    return b;
+#else
+    return g_ct_trace_shared_buffer;
+#endif
+}
+
+void ct_trace_init(const char* file) {
+    if(!file || !*file) {
+        return;
+    }
+    g_ct_trace_file = (char*)malloc(strlen(file)+1);
+    strcpy(g_ct_trace_file, file);
+    g_ct_trace_start = ct_seconds();
+#ifdef CT_PTHREADS
+    pthread_key_create(&g_ct_trace_key, 0);
+#else
+    g_ct_trace_shared_buffer = ct_trace_new_buffer();
+#endif
+    g_ct_trace = 1;
+}
+
+void ct_trace_event(int kind, double start, double end, int arg) {
+    ct_trace_buffer* b = ct_trace_buffer_of_thread();
+    /* an atomic increment is only needed for the shared buffer, but it's cheap
+       when uncontended, which per-thread buffers always are. */
+    unsigned long pos = ATOMIC_FETCH_THEN_INCR(&b->pos, 1);
+    ct_trace_rec* rec = &b->recs[pos % CT_TRACE_CAPACITY];
+    rec->start = start;
+    rec->end = end;
+    rec->kind = kind;
+    rec->arg = arg;
+}
+
+void ct_trace_write(FILE* f) {
+    const char* sep = "";
+    int pid = getpid();
+    ct_trace_buffer* b;
+    fprintf(f, "{\"traceEvents\":[\n");
+    for(b=g_ct_trace_buffers; b; b=b->next) {
+        unsigned long pos = b->pos;
+        unsigned long i = pos > CT_TRACE_CAPACITY ? pos - CT_TRACE_CAPACITY : 0;
+        fprintf(f, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":%d,\"tid\":%d,\"args\":{\"name\":\"thread %d\"}}",
+                sep, pid, b->tid, b->tid);
+        sep = ",\n";
+        for(; i<pos; ++i) {
+            const ct_trace_rec* rec = &b->recs[i % CT_TRACE_CAPACITY];
+            fprintf(f, ",\n{\"name\":\"%s\",\"cat\":\"ct\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%d",
+                    g_ct_trace_names[rec->kind],
+                    (rec->start - g_ct_trace_start)*1e6, (rec->end - rec->start)*1e6,
+                    pid, b->tid);
+            if(rec->kind == CT_TRACE_LOOP) {
+                fprintf(f, ",\"args\":{\"n\":%d}}", rec->arg);
+            }
+            else if(rec->kind != CT_TRACE_IDLE) {
+                fprintf(f, ",\"args\":{\"indexes\":%d}}", rec->arg);
+            }
+            else {
+                fprintf(f, "}");
+            }
+        }
+        if(pos > CT_TRACE_CAPACITY) {
+            printf("checkedthreads - WARNING: trace of thread %d lost %lu oldest events\n",
+                    b->tid, pos - CT_TRACE_CAPACITY);
+        }
+    }
+    fprintf(f, "\n],\"displayTimeUnit\":\"ns\"}\n");
+}
+
+/* called after the scheduler is finalized, so nobody records events concurrently */
+void ct_trace_fini(void) {
+    FILE* f;
+    if(!g_ct_trace) {
+        return;
+    }
+    g_ct_trace = 0;
+    f = fopen(g_ct_trace_file, "w");
+    if(f) {
+        ct_trace_write(f);
+        fclose(f);
+    }
+    else {
+        printf("checkedthreads - WARNING: can't write $CT_TRACE (%s)\n", g_ct_trace_file);
+    }
+    while(g_ct_trace_buffers) {
+        ct_trace_buffer* next = g_ct_trace_buffers->next;
+        free(g_ct_trace_buffers->recs);
+        free(g_ct_trace_buffers);
+        g_ct_trace_buffers = next;
+    }
+    g_ct_trace_num_buffers = 0;
+    free(g_ct_trace_file);
+    g_ct_trace_file = 0;
+#ifdef CT_PTHREADS
+    pthread_key_delete(g_ct_trace_key);
+#endif
+}
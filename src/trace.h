@@ -0,0 +1,34 @@
+/*
+ * Timeline tracing ($CT_TRACE=file.json). Events are recorded into per-thread
+ * ring buffers and written out at ct_fini in the Chrome trace-event format
+ * (load the file with chrome://tracing or https://ui.perfetto.dev.)
+ */
+#ifndef CT_TRACE_H_
+#define CT_TRACE_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+enum {
+    CT_TRACE_LOOP, /* a ct_for call, from entry to exit */
+    CT_TRACE_CHUNK, /* a worker running indexes of a loop it was woken up for */
+    CT_TRACE_STEAL, /* a thread waiting for its own loop running indexes of another */
+    CT_TRACE_IDLE, /* a worker waiting for work */
+    CT_TRACE_KINDS
+};
+
+extern int g_ct_trace; /* non-0 if tracing is on; check before calling ct_trace_event */
+
+void ct_trace_init(const char* file); /* file may be 0, which turns tracing off */
+void ct_trace_fini(void); /* writes the file */
+
+/* start & end are ct_seconds() values; arg is the loop size for CT_TRACE_LOOP
+   and the number of indexes run for CT_TRACE_CHUNK/CT_TRACE_STEAL */
+void ct_trace_event(int kind, double start, double end, int arg);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CT_TRACE_H_ */
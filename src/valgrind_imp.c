@@ -1,32 +1,55 @@
 #include <stdio.h>
-#include <stdint.h>
 #include <stdlib.h>
 #include "imp.h"
+#include "perm.h"
+
+/* Valgrind client requests - the tool's opcodes; must match the ct_request enum
+   in valgrind/checkedthreads_main.c. ('C','T') is the tool's request base, as
+   in VG_USERREQ_TOOL_BASE('C','T'). */
+#define CT_REQ_BASE (('C' << 24) | ('T' << 16))
+enum {
+    CT_REQ_BEGIN_FOR = CT_REQ_BASE, /* arg1: stackbot; push state, deactivate checking */
+    CT_REQ_END_FOR, /* pop state (possibly re-activating checking) */
+    CT_REQ_ITER, /* arg1: thread, arg2: index; activate checking */
+    CT_REQ_DONE, /* arg1: index; deactivate checking */
+    CT_REQ_GET_OWNER /* arg1: address; returns the owner */
+};
 
-#define STORED_MAGIC 0x12345678
-#define CONST_MAGIC "Valgrind command"
-#define MAX_CMD 128
-
-struct {
-    volatile int32_t stored_magic;
-    const char const_magic[16];
-    volatile char payload[MAX_CMD];
-} g_ct_valgrind_cmd = { 0, CONST_MAGIC, "" };
-
-void ct_valgrind_ptr(int oft, volatile const void* ptr) {
-    *(volatile const void**)&g_ct_valgrind_cmd.payload[oft] = ptr;
-}
-
-void ct_valgrind_int(int oft, int num) {
-    *(volatile int32_t*)&g_ct_valgrind_cmd.payload[oft] = num;
-}
-
-void ct_valgrind_cmd(const char* str) {
-    int i;
-    for(i=0; str[i]; ++i) {
-        g_ct_valgrind_cmd.payload[i] = str[i];
-    }
-    g_ct_valgrind_cmd.stored_magic = STORED_MAGIC;
+/* VALGRIND_DO_CLIENT_REQUEST_EXPR from valgrind.h, without needing valgrind.h:
+   a sequence of rotations which is a no-op natively and which Valgrind
+   recognizes and replaces with a call to the tool. returns dflt when not
+   running under Valgrind (and on targets where the sequence isn't known.) */
+static unsigned long ct_valgrind_request(unsigned long request, unsigned long arg1, unsigned long arg2,
+                                         unsigned long dflt) {
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+    volatile unsigned long args[6];
+    unsigned long result;
+    args[0] = request;
+    args[1] = arg1;
+    args[2] = arg2;
+    args[3] = 0;
+    args[4] = 0;
+    args[5] = 0;
+#if defined(__x86_64__)
+    __asm__ __volatile__("rolq $3, %%rdi ; rolq $13, %%rdi\n\t"
+                         "rolq $61, %%rdi ; rolq $51, %%rdi\n\t"
+                         "xchgq %%rbx,%%rbx"
+                         : "=d" (result)
+                         : "a" (&args[0]), "0" (dflt)
+                         : "cc", "memory");
+#else
+    __asm__ __volatile__("roll $3, %%edi ; roll $13, %%edi\n\t"
+                         "roll $29, %%edi ; roll $19, %%edi\n\t"
+                         "xchgl %%ebx,%%ebx"
+                         : "=d" (result)
+                         : "a" (&args[0]), "0" (dflt)
+                         : "cc", "memory");
+#endif
+    return result;
+#else
+    (void)request; (void)arg1; (void)arg2;
+    return dflt;
+#endif
 }
 
 void ct_shuffle_init(const ct_env_var* env);
@@ -37,35 +60,29 @@ void ct_valgrind_init(const ct_env_var* env) {
 void ct_valgrind_fini(void) {
 }
 
-int* ct_rand_perm(int n);
-
 void ct_valgrind_for_loop(int n, ct_ind_func f, void* context, ct_canceller* c) {
     int i;
-    int* perm;
-    /* deactivate so that random permutation generation is not "checked" */
-    ct_valgrind_int(8, 0);
-    ct_valgrind_cmd("setactiv");
-
-    perm = ct_rand_perm(n);
+    ct_perm perm;
+    ct_perm_scope scope, *enclosing = g_ct_perm_scope;
+    /* checking was deactivated by CT_REQ_BEGIN_FOR, so that random permutation
+       generation is not "checked" */
+    ct_perm_init(&perm, n, enclosing);
 
     for(i=0; i<n; ++i) {
-        int ind = perm[i];
+        int ind = ct_perm_at(&perm, i); /* checking is still deactivated here */
+        ct_perm_enter(&scope, &perm, ind);
+        g_ct_perm_scope = &scope;
         /* thread ID != index because of thread-local storage, if we ever add that...
-           [and because of the ID range being smaller... but that's another matter.] */
-        ct_valgrind_int(4, ind%254); /* there are 254 IDs (0 and 255 are reserved;
-                                      1 is added by Valgrind and subtracted back in messages). */
-        ct_valgrind_cmd("thrd");
-
-        ct_valgrind_int(4, ind);
-        ct_valgrind_cmd("iter"); /* activate checking */
+           [and because of the ID range being smaller... but that's another matter.]
+           there are 254 IDs (0 and 255 are reserved; 1 is added by Valgrind and
+           subtracted back in messages). */
+        ct_valgrind_request(CT_REQ_ITER, ind%254, ind, 0); /* activate checking */
 
         f(ind, context);
 
-        ct_valgrind_int(4, ind); /* deactivate checking */
-        ct_valgrind_cmd("done");
+        ct_valgrind_request(CT_REQ_DONE, ind, 0, 0); /* deactivate checking */
     }
-
-    free(perm);
+    g_ct_perm_scope = enclosing;
 }
 
 /* "volatile" for portable inlining prevention (instead of __attribute__((noinline))) */
@@ -74,24 +91,16 @@ volatile ct_imp_for_func g_ct_valgrind_for = &ct_valgrind_for_loop;
 /* under Valgrind, loops run to completion even if canceled */
 void ct_valgrind_for(int n, ct_ind_func f, void* context, ct_canceller* c) {
     volatile int local=0;
-    ct_valgrind_cmd("begin_for"); /* push state (including whether checking is activated) */
-
-    ct_valgrind_ptr(8, &local);
-    ct_valgrind_cmd("stackbot");
+    /* push state (including whether checking is activated); writes below &local are ignored */
+    ct_valgrind_request(CT_REQ_BEGIN_FOR, (unsigned long)&local, 0, 0);
 
     (*g_ct_valgrind_for)(n,f,context,c);
 
-    ct_valgrind_cmd("end_for"); /* pop state (possibly re-activating checking) */
+    ct_valgrind_request(CT_REQ_END_FOR, 0, 0, 0); /* pop state (possibly re-activating checking) */
 }
 
 int ct_debug_get_owner(const void* addr) {
-    volatile int i,m;
-    ct_valgrind_ptr(8, addr);
-    ct_valgrind_cmd("getowner");
-    for(i=0; i<5; ++i) {
-        m = g_ct_valgrind_cmd.stored_magic;
-    }
-    return g_ct_valgrind_cmd.stored_magic == STORED_MAGIC ? CT_OWNER_UNKNOWN : g_ct_valgrind_cmd.stored_magic;
+    return (int)(long)ct_valgrind_request(CT_REQ_GET_OWNER, (unsigned long)addr, 0, (unsigned long)(long)CT_OWNER_UNKNOWN);
 }
 
 ct_imp g_ct_valgrind_imp = {
@@ -100,4 +109,9 @@ ct_imp g_ct_valgrind_imp = {
     &ct_valgrind_fini,
     &ct_valgrind_for,
     0, 0, 0, /* cancelling functions (TODO: some should be non-0) */
+    0, /* statistics */
+    0, /* priorities */
+    0, 0, 0, 0, /* pools */
+    0, /* resizing */
+    0, /* pool size */
 };
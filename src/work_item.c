@@ -1,22 +1,86 @@
 #include "work_item.h"
 #include "atomic.h"
+#include "stats.h"
 
-void ct_work(ct_work_item* item) {
+/* called by whoever ran the last indexes of the item - if someone is blocked
+   waiting for it, we wake them up, and otherwise make sure nobody will block. */
+void ct_work_done(ct_work_item* item, int done) {
+    if(ATOMIC_FETCH_THEN_DECR(&item->to_do, done) == done) {
+        ct_work_waiter* waiter = ATOMIC_COMPARE_AND_SWAP(&item->waiter, (ct_work_waiter*)0, CT_WORK_DONE);
+        if(waiter) {
+            pthread_mutex_lock(&waiter->mutex);
+            waiter->signaled = 1;
+            pthread_cond_signal(&waiter->cond);
+            pthread_mutex_unlock(&waiter->mutex);
+        }
+    }
+}
+
+/* reading the clock costs about as much as a short index, so we only look at
+   it every this many indexes claimed */
+#define CT_DEADLINE_CHECK_INDEXES 16
+
+int ct_work(ct_work_item* item, double deadline) {
     int n = item->n;
+    int done = 0;
+    int until_check = CT_DEADLINE_CHECK_INDEXES;
     ct_ind_func f = item->f;
     void* context = item->context;
+    volatile int* preempt = item->preempt;
+    volatile int* pool_size = item->pool_size;
     while(item->next_ind < n) {
-        int next_ind = ATOMIC_FETCH_THEN_INCR(&item->next_ind, 1);
+        int next_ind;
+        if((preempt && *preempt) || (pool_size && *pool_size > item->queued_for)) {
+            break;
+        }
+        if(deadline && --until_check == 0) {
+            if(ct_seconds() >= deadline) {
+                break;
+            }
+            until_check = CT_DEADLINE_CHECK_INDEXES;
+        }
+        next_ind = ATOMIC_FETCH_THEN_INCR(&item->next_ind, 1);
         if(next_ind < n) { /* it could have exceeded n because of the concurrent increment above */
             ct_canceller* canceller = item->canceller;
             if(canceller && canceller->cancelled) {
-                item->to_do = 0; /* note that this can bring to_do to a negative value
-                                    because of concurrent decrements; which is OK. */
-                item->next_ind = n; /* OK similarly to to_do above. */
+                /* claim all the remaining indexes, and count them as done along with ours.
+                   we mustn't zero to_do outright - indexes still running elsewhere would
+                   then outlive the loop (and the context they're given.) */
+                int rest = item->next_ind;
+                while(rest < n) {
+                    int got = ATOMIC_COMPARE_AND_SWAP(&item->next_ind, rest, n);
+                    if(got == rest) {
+                        break;
+                    }
+                    rest = got;
+                }
+                ct_work_done(item, 1 + (rest < n ? n - rest : 0));
                 break;
             }
             f(next_ind, context);
-            ATOMIC_FETCH_THEN_DECR(&item->to_do, 1);
+            ct_work_done(item, 1);
+            ++done;
+        }
+    }
+    return done;
+}
+
+void ct_work_wait(ct_work_item* item) {
+    ct_work_waiter waiter;
+    pthread_mutex_init(&waiter.mutex, 0);
+    pthread_cond_init(&waiter.cond, 0);
+    waiter.signaled = 0;
+    /* if to_do reached 0 already, the item is marked CT_WORK_DONE and we don't wait;
+       otherwise, whoever brings it to 0 will find us and signal. (our waiter lives on
+       the stack, so we must wait until the signaling thread is done with it even if
+       we see to_do reach 0 before that.) */
+    if(ATOMIC_COMPARE_AND_SWAP(&item->waiter, (ct_work_waiter*)0, &waiter) == 0) {
+        pthread_mutex_lock(&waiter.mutex);
+        while(!waiter.signaled) {
+            pthread_cond_wait(&waiter.cond, &waiter.mutex);
         }
+        pthread_mutex_unlock(&waiter.mutex);
     }
+    pthread_mutex_destroy(&waiter.mutex);
+    pthread_cond_destroy(&waiter.cond);
 }
@@ -2,6 +2,14 @@
 #define CT_WORK_ITEM_H_
 
 #include "imp.h"
+#include <pthread.h>
+
+/* a thread blocked in ct_work_wait */
+typedef struct {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    volatile int signaled;
+} ct_work_waiter;
 
 typedef struct {
     volatile int next_ind;
@@ -11,11 +19,26 @@ typedef struct {
     ct_ind_func f;
     void* context;
     ct_canceller* volatile canceller;
+    volatile int* preempt; /* if not 0, we stop claiming indexes once *preempt is non-0 */
+    /* if not 0, we stop claiming indexes once *pool_size exceeds queued_for (the pool
+       size when the item was last queued) - so that threads added to the pool get
+       entries of the item queued for them. */
+    volatile int* pool_size;
+    volatile int queued_for;
+    ct_work_waiter* volatile waiter; /* 0, the waiter to signal when to_do reaches 0, or CT_WORK_DONE */
 } ct_work_item;
 
-/* returns when next_ind reaches or exceeds n - all work was already yanked.
-   this doesn't mean we're done - to_do==0 means that. */
-void ct_work(ct_work_item* item);
+#define CT_WORK_DONE ((ct_work_waiter*)1)
 
-#endif
+/* returns when next_ind reaches or exceeds n - all work was already yanked -
+   when preempted or the pool grew, or when the deadline (a ct_seconds() time; 0 means none)
+   has passed (then, there may be indexes left to claim.) the deadline is only
+   checked every few indexes, so we may run a few past it.
+   this doesn't mean we're done - to_do==0 means that.
+   the return value is the number of indexes we ran. */
+int ct_work(ct_work_item* item, double deadline);
 
+/* blocks until to_do reaches 0. only one thread may wait for an item. */
+void ct_work_wait(ct_work_item* item);
+
+#endif
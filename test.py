@@ -4,7 +4,11 @@
 * "sleep" should sleep "quickly" with all enabled schedulers (partitioning test)
 * random checker should find bugs.
 * valgrind checker should find bugs.
+* the valgrind checker, built without valgrind (test/valgrind_driver.c), should agree with a reference model.
 * various stuff - like find, sort and accumulate.
+
+"./test.py perf" runs the timing tests instead, and compares them to a baseline
+recorded on this machine by "./test.py perf update" (see test/perf.py.)
 '''
 import os
 import sys
@@ -26,6 +30,12 @@ def buildtest(*args):
     built.append(build.buildtest(*args))
 
 buildtest('hello_ct.c')
+buildtest('stats.c')
+buildtest('grain_auto.c')
+buildtest('pool.c')
+buildtest('elastic.c')
+buildtest('perm.c')
+buildtest('fork.c')
 if with_pthreads: buildtest('hello_ct.c','_pthreads')
 if with_openmp: buildtest('hello_ct.c','_openmp')
 
@@ -34,13 +44,15 @@ if with_cpp:
     if with_pthreads: buildtest('hello_ctx.cpp','_pthreads')
     if with_openmp: buildtest('hello_ctx.cpp','_openmp')
     if with_tbb: buildtest('hello_ctx.cpp','_tbb')
+    if with_pthreads: buildtest('prio.cpp')
 
 for test in tests:
     if test.endswith('.cpp') and not with_cpp:
         continue
     buildtest(test)
 
-scheds = 'serial shuffle valgrind openmp tbb pthreads'.split()
+scheds = 'serial shuffle valgrind openmp tbb pthreads'.split() + (['pshuffle'] if with_pthreads else []) + \
+         (['fork'] if sys.platform.startswith('linux') else [])
 # remove schedulers which we aren't configured to support
 def lower(ls): return [s.lower() for s in ls]
 scheds = [sched for sched in scheds if not (sched in lower(build.features) \
@@ -68,20 +80,23 @@ def runcommand(command,expected_status=0,expected_output=None):
         fail(command)
     return status, output, command
 
-print '\nrunning tests'
+if sys.argv[1:2] == ['perf']:
+    execfile('test/perf.py')
+else:
+    print '\nrunning tests'
 
-testscripts = 'hello.py bug.py nested.py sleep.py'.split()
+    testscripts = 'hello.py bug.py nested.py sleep.py stats.py trace.py grain_auto.py prio.py pool.py elastic.py perm.py fork.py valgrind_driver.py'.split()
 
-for testscript in testscripts:
-    execfile('test/'+testscript)
+    for testscript in testscripts:
+        execfile('test/'+testscript)
 
-for test in built:
-    if test in 'bug nested sleep'.split() or test.startswith('hello'):
-        continue
-    if test == 'sort':
-        runtest(test,args=str(1024*1024))
-    else:
-        runtest(test)
+    for test in built:
+        if test in 'bug nested sleep stats grain_auto prio pool elastic perm fork'.split() or test.startswith('hello'):
+            continue
+        if test == 'sort':
+            runtest(test,args=str(1024*1024))
+        else:
+            runtest(test)
 
 if failed:
     print 'FAILED:'
@@ -8,6 +8,20 @@ if s1 == s2 or (s1 != 0 and s2 != 0):
 elif verbose:
     print ' ','bug found when running one of the random orders'
 
+# with a single thread, pshuffle runs the very same schedules:
+if 'pshuffle' in scheds:
+    for rev in [0,1]:
+        s1, o1, c1 = runtest('bug',expected_status=None,CT_SCHED='shuffle',CT_RAND_REV=rev)
+        s2, o2, c2 = runtest('bug',expected_status=None,CT_SCHED='pshuffle',CT_RAND_REV=rev,CT_THREADS=1)
+        if (s1,o1) != (s2,o2):
+            fail(c2)
+
+# the fork scheduler should find the bug - and the loop - in a single run:
+if 'fork' in scheds:
+    s, o, c = runtest('bug',expected_status=None,CT_SCHED='fork')
+    if 'loop #1, ct_for(100), gives different results' not in o:
+        fail(c)
+
 # run bug under valgrind:
 s1, o1, c1 = runcommand('env CT_SCHED=valgrind valgrind --tool=checkedthreads ./bin/bug',expected_status=None)
 s2, o2, c2 = runcommand('env CT_SCHED=valgrind CT_RAND_REV=1 valgrind --tool=checkedthreads ./bin/bug',expected_status=None)
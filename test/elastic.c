@@ -0,0 +1,127 @@
+#define _POSIX_C_SOURCE 200112L /* nanosleep */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "checkedthreads.h"
+
+#define N 1000
+#define SLOW_N 400 /* indexes of SLOW_MSEC each */
+#define SLOW_MSEC 2
+#define MAX_WORKERS 16
+
+int g_array[N];
+
+/* index 0 resizes the pool while the other indexes run */
+void resize(int index, void* context) {
+    if(index == 0) {
+        ct_set_num_threads(*(int*)context);
+    }
+    g_array[index] += index;
+}
+
+void sleep_msec(int msec) {
+    struct timespec ts;
+    ts.tv_sec = msec / 1000;
+    ts.tv_nsec = (msec % 1000) * 1000000L;
+    nanosleep(&ts, 0);
+}
+
+/* index 0 grows the pool to 8 threads; the rest take a while, so that the new
+   threads have a chance to join the loop in flight */
+void grow(int index, void* context) {
+    if(index == 0) {
+        ct_set_num_threads(8);
+    }
+    else {
+        sleep_msec(SLOW_MSEC);
+    }
+}
+
+/* the number of threads in the process, or -1 where /proc doesn't tell */
+int num_threads(void) {
+    char line[256];
+    int n = -1;
+    FILE* f = fopen("/proc/self/status", "r");
+    if(!f) {
+        return -1;
+    }
+    while(fgets(line, sizeof line, f)) {
+        if(strncmp(line, "Threads:", 8) == 0) {
+            n = atoi(line + 8);
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+/* waits for up to a second for the process to be down to the main thread */
+int wait_for_threads_to_exit(void) {
+    int i;
+    for(i=0; i<100 && num_threads() > 1; ++i) {
+        sleep_msec(10);
+    }
+    return num_threads() <= 1;
+}
+
+int main() {
+    int sizes[] = {4, 2, 8, 1, 3};
+    int i, j, rounds = sizeof sizes / sizeof sizes[0], num_workers;
+    const char* sched = getenv("CT_SCHED");
+    const char* timeout = getenv("CT_IDLE_TIMEOUT_MSEC");
+    int pthreads = sched && strcmp(sched, "pthreads") == 0;
+    ct_stats total;
+
+    ct_init(0);
+    for(i=0; i<rounds; ++i) {
+        ct_for(N, resize, &sizes[i], 0);
+    }
+    for(j=0; j<N; ++j) {
+        if(g_array[j] != j*rounds) {
+            printf("error at %d!\n", j);
+            return 1;
+        }
+    }
+
+    /* the statistics cover every thread the pool ever had */
+    num_workers = ct_get_stats(&total, 0, 0);
+    if(pthreads && (num_workers != 8 || total.indexes != (unsigned long)N*rounds)) {
+        printf("error: %d workers (expected 8), %lu indexes (expected %lu)\n",
+               num_workers, total.indexes, (unsigned long)N*rounds);
+        return 1;
+    }
+
+    if(pthreads) {
+        /* threads added while a loop runs join it: it starts out queued for 2 threads,
+           so without that, at most 2 workers would run its indexes */
+        ct_stats before[MAX_WORKERS], after[MAX_WORKERS];
+        int working = 0;
+        ct_set_num_threads(2);
+        ct_get_stats(0, before, MAX_WORKERS);
+        ct_for(SLOW_N, grow, 0, 0);
+        num_workers = ct_get_stats(0, after, MAX_WORKERS);
+        for(j=0; j<num_workers && j<MAX_WORKERS; ++j) {
+            working += after[j].indexes > before[j].indexes;
+        }
+        if(working < 4) {
+            printf("error: %d workers ran the indexes of a loop growing the pool to 8 threads\n", working);
+            return 1;
+        }
+
+        /* surplus threads exit; with an idle timeout, so do the rest - and come back for the next loop */
+        ct_set_num_threads(timeout ? 3 : 1);
+        if(!wait_for_threads_to_exit()) {
+            printf("error: %d threads still running\n", num_threads());
+            return 1;
+        }
+        ct_for(N, resize, &sizes[rounds-1], 0);
+        for(j=0; j<N; ++j) {
+            if(g_array[j] != j*(rounds+1)) {
+                printf("error at %d after the threads exited!\n", j);
+                return 1;
+            }
+        }
+    }
+    ct_fini();
+    return 0;
+}
@@ -0,0 +1,9 @@
+# elastic: ct_set_num_threads resizing the pool from inside its loops; under pthreads,
+# the statistics show every thread the pool had, threads added while a loop runs
+# join it, and surplus threads exit - as do idle
+# ones with $CT_IDLE_TIMEOUT_MSEC - and are re-spawned by the next loop.
+for sched in scheds:
+    runtest('elastic',CT_SCHED=sched,CT_THREADS=2)
+if 'pthreads' in scheds:
+    runtest('elastic',CT_SCHED='pthreads',CT_THREADS=2,CT_IDLE_TIMEOUT_MSEC=5)
+    runtest('elastic',CT_SCHED='pthreads',CT_THREADS=2,CT_IDLE_TIMEOUT_MSEC=5,CT_SPIN_USEC='adaptive')
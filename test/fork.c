@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "checkedthreads.h"
+
+#define N 1000
+#define RECORD "index\n"
+
+/* race-free, but the blocks get different addresses in different orders */
+void alloc_index(int index, void* context) {
+    char** ptrs = (char**)context;
+    ptrs[index] = (char*)malloc(64);
+}
+
+/* writes a record to a descriptor opened before the loop */
+void write_index(int index, void* context) {
+    int fd = *(int*)context;
+    if(write(fd, RECORD, strlen(RECORD)) != (int)strlen(RECORD)) {
+        printf("error writing index %d\n", index);
+    }
+}
+
+/* alloc: allocating in a loop isn't reported by CT_SCHED=fork;
+   write FILE: a loop writing to an open file writes it once */
+int main(int argc, char** argv) {
+    int i;
+    ct_init(0);
+    if(argc > 1 && strcmp(argv[1], "alloc") == 0) {
+        char* ptrs[N];
+        ct_for(N, alloc_index, ptrs, 0);
+        for(i=0; i<N; ++i) {
+            free(ptrs[i]);
+        }
+    }
+    else if(argc > 2 && strcmp(argv[1], "write") == 0) {
+        long size;
+        int fd = open(argv[2], O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+        if(fd < 0) {
+            printf("error: can't open %s\n", argv[2]);
+            return 1;
+        }
+        ct_for(N, write_index, &fd, 0);
+        size = (long)lseek(fd, 0, SEEK_END);
+        close(fd);
+        if(size != (long)(N*strlen(RECORD))) {
+            printf("error: %ld bytes written, expected %ld\n", size, (long)(N*strlen(RECORD)));
+            return 1;
+        }
+    }
+    else {
+        printf("usage: %s alloc | write FILE\n", argv[0]);
+        return 1;
+    }
+    ct_fini();
+    return 0;
+}
@@ -0,0 +1,6 @@
+# fork: loops allocating memory aren't reported by the fork scheduler, though the
+# blocks' addresses differ in the two orders; loops writing to the program's open
+# files write them once. the other schedulers should pass, too.
+for sched in scheds:
+    runtest('fork','alloc',expected_output='',CT_SCHED=sched)
+    runtest('fork','write bin/fork.out',expected_output='',CT_SCHED=sched)
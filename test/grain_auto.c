@@ -0,0 +1,58 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkedthreads.h"
+
+#define N (64*1024)
+#define RUNS 10
+#define POOL_THREADS 16
+#define CHUNKS_PER_THREAD 4 /* the least the tuning leaves each thread, as in grain.c */
+
+void index_callback(int index, void* context) {
+    int* array = (int*)context;
+    array[index] += index;
+}
+
+int main() {
+    int* array = (int*)calloc(N, sizeof(int));
+    ct_stats before, after;
+    const char* grain = getenv("CT_GRAIN");
+    const char* sched = getenv("CT_SCHED");
+    int i, r, num_workers = 0;
+
+    ct_init(0);
+    for(r=0; r<RUNS; ++r) {
+        num_workers = ct_get_stats(&before, 0, 0);
+        ct_for(N, index_callback, array, 0);
+        ct_get_stats(&after, 0, 0);
+    }
+    for(i=0; i<N; ++i) {
+        if(array[i] != i*RUNS) {
+            printf("error at %d!\n", i);
+            return 1;
+        }
+    }
+    /* with the tuning done, the scheduler should be seeing far fewer tasks than indexes
+       (except under pshuffle, which keeps the indexes separate so as to shuffle them) */
+    if(num_workers && !(sched && strcmp(sched, "pshuffle") == 0) && grain && strcmp(grain, "auto") == 0 && after.indexes - before.indexes >= N) {
+        printf("error: %lu tasks scheduled for %d trivial indexes\n", after.indexes - before.indexes, N);
+        return 1;
+    }
+    /* in a pool larger than $CT_THREADS, the chunks are sized for the pool's threads */
+    if(sched && strcmp(sched, "pthreads") == 0 && grain && strcmp(grain, "auto") == 0) {
+        ct_pool* pool = ct_alloc_pool(POOL_THREADS);
+        for(r=0; r<RUNS; ++r) {
+            ct_pool_get_stats(pool, &before, 0, 0);
+            ct_pool_for(pool, N, index_callback, array, 0);
+            ct_pool_get_stats(pool, &after, 0, 0);
+        }
+        ct_free_pool(pool);
+        if(after.indexes - before.indexes < POOL_THREADS*CHUNKS_PER_THREAD) {
+            printf("error: %lu tasks scheduled for a pool of %d threads\n", after.indexes - before.indexes, POOL_THREADS);
+            return 1;
+        }
+    }
+    ct_fini();
+    free(array);
+    return 0;
+}
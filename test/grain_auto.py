@@ -0,0 +1,11 @@
+# grain_auto: $CT_GRAIN=auto should coalesce trivial indexes under the parallel schedulers,
+# and change nothing under the serial ones (or pshuffle); in pools, the chunks are sized
+# for the pool's threads. (tbb is only in the C++ library, so the C programs skip it -
+# hello_ctx covers it.)
+for sched in scheds:
+    if sched != 'tbb':
+        runtest('grain_auto',CT_SCHED=sched,CT_GRAIN='auto',CT_THREADS=2)
+        runtest('hello_ct',expected_output=hello_output,CT_SCHED=sched,CT_GRAIN='auto')
+    if with_cpp:
+        runtest('hello_ctx',expected_output=hello_output,CT_SCHED=sched,CT_GRAIN='auto')
+        runtest('cancel',CT_SCHED=sched,CT_GRAIN='auto')
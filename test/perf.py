@@ -0,0 +1,91 @@
+# perf: run the timing tests several times per scheduler and compare the medians
+# against test/perf_baseline.json. timings only compare on the machine they were
+# measured on, so no baseline is shipped: "./test.py perf update" creates the file
+# locally (it's ignored by git.) baselines are keyed by core count, so that runs
+# with different numbers of cores don't mix.
+import json
+import re
+
+perf_tests = [('sort',str(1024*1024)), ('acc',''), ('grain',''), ('cancel','')]
+perf_runs = int(os.getenv('CT_PERF_RUNS',5))
+perf_threshold = float(os.getenv('CT_PERF_THRESHOLD',0.25)) # allowed relative slowdown
+perf_slack_usec = float(os.getenv('CT_PERF_SLACK_USEC',2000)) # sub-millisecond timings are mostly noise
+perf_baseline_file = 'test/perf_baseline.json'
+perf_cores = str(os.sysconf('SC_NPROCESSORS_ONLN'))
+perf_update = 'update' in sys.argv[2:]
+
+def perf_metrics(test,output):
+    '''"label: number" lines are timings; a line without a number starts a section
+    (as in cancel's "plain loop"/"nested loop"); "N seconds" is converted to usec.'''
+    metrics = {}
+    section = ''
+    for line in output.split('\n'):
+        m = re.match(r'^\s*([^:]+):\s*([0-9.]+)( seconds)?\s*$',line)
+        if m:
+            label,value,seconds = m.groups()
+            metrics['/'.join([x for x in [test,section,label] if x])] = float(value)*(1e6 if seconds else 1)
+        elif ':' not in line:
+            section = line.strip()
+    return metrics
+
+def median(values):
+    s = sorted(values)
+    return s[len(s)/2]
+
+def spread(values):
+    '''median absolute deviation - unlike max-min, not thrown off by a single outlier'''
+    m = median(values)
+    return median([abs(v-m) for v in values])
+
+print '\nmeasuring performance (%d runs per test and scheduler, %s cores)'%(perf_runs,perf_cores)
+
+results = {}
+for sched in scheds:
+    if sched == 'valgrind':
+        continue
+    samples = {}
+    for test,args in perf_tests:
+        if test not in built:
+            continue
+        for run in range(perf_runs):
+            status,output,command = runtest(test,args=args,CT_SCHED=sched)
+            for metric,value in perf_metrics(test,output).items():
+                samples.setdefault(metric,[]).append(value)
+    results[sched] = dict([(metric,dict(median=median(values),spread=spread(values)))
+                           for metric,values in samples.items()])
+
+try:
+    baselines = json.load(open(perf_baseline_file))
+except IOError:
+    baselines = {}
+
+if perf_update:
+    baselines[perf_cores] = results
+    open(perf_baseline_file,'w').write(json.dumps(baselines,indent=1,sort_keys=True,separators=(',',': '))+'\n')
+    print ' ','wrote the baseline for %s cores to %s'%(perf_cores,perf_baseline_file)
+elif perf_cores not in baselines:
+    print ' ','no baseline for %s cores in %s - run "./test.py perf update" on this machine to create one'%(
+        perf_cores,perf_baseline_file)
+else:
+    baseline = baselines[perf_cores]
+    report = []
+    for sched in sorted(results):
+        for metric in sorted(results[sched]):
+            now = results[sched][metric]
+            base = baseline.get(sched,{}).get(metric)
+            if not base:
+                continue
+            change = (now['median'] - base['median']) / base['median'] if base['median'] else 0
+            allowed = base['median']*(1+perf_threshold) + max(3*base['spread'],perf_slack_usec)
+            slower = now['median'] > allowed
+            if slower or verbose:
+                report.append('  %-10s %-40s %12.0f %12.0f %+7.0f%%%s'%(sched,metric,base['median'],now['median'],change*100,
+                                                                      '  SLOWER' if slower else ''))
+            if slower:
+                failed.append('%s under CT_SCHED=%s: median %.0f usec vs. baseline %.0f (+-%.0f)'%(
+                    metric,sched,now['median'],base['median'],base['spread']))
+    if report:
+        print '  %-10s %-40s %12s %12s %8s'%('scheduler','timing','baseline','now','change')
+        print '\n'.join(report)
+    else:
+        print ' ','no slowdowns beyond %d%% of the baseline'%(perf_threshold*100)
@@ -0,0 +1,78 @@
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "checkedthreads.h"
+
+#define N 20
+#define HUGE_N 2000000000
+
+int g_order[N];
+int g_pos;
+
+void record(int index, void* context) {
+    (void)context;
+    g_order[g_pos++] = index;
+}
+
+/* "nested first": under pshuffle with 2 threads, the two indexes of a loop each
+   run a nested loop, one after the other - index first's loop first. while one
+   thread runs its nested loop, the other one waits in its index, so that each
+   nested loop runs on a single thread, and we see its order. the nested loops'
+   orders shouldn't depend on which of them was started first. */
+int g_nested_order[2][N];
+int g_nested_pos[2];
+volatile int g_turn = 0;
+int g_first = 0;
+
+void record_nested(int index, void* context) {
+    int outer = *(int*)context;
+    g_nested_order[outer][g_nested_pos[outer]++] = index;
+}
+
+void run_nested(int index, void* context) {
+    int turn = index == g_first ? 0 : 1;
+    (void)context;
+    while(g_turn != turn); /* the other index's nested loop goes first */
+    ct_for(N, record_nested, &index, 0);
+    g_turn++;
+    while(g_turn != 2); /* don't help with the other index's nested loop */
+}
+
+int nested(int first) {
+    int i, j;
+    g_first = first;
+    ct_init(0);
+    ct_for(2, run_nested, 0, 0);
+    ct_fini();
+    for(i=0; i<2; ++i) {
+        for(j=0; j<N; ++j) {
+            printf("%d%s", g_nested_order[i][j], j+1<N ? " " : "\n");
+        }
+    }
+    return 0;
+}
+
+void cancel_at_once(int index, void* context) {
+    (void)index;
+    ct_cancel((ct_canceller*)context);
+}
+
+/* prints the order in which a serial scheduler ran the indexes of a loop; also,
+   a huge loop should start right away (rather than allocating a permutation first) */
+int main(int argc, char** argv) {
+    ct_canceller* c;
+    int i;
+    if(argc > 2 && strcmp(argv[1], "nested") == 0) {
+        return nested(atoi(argv[2]));
+    }
+    ct_init(0);
+    ct_for(N, record, 0, 0);
+    for(i=0; i<N; ++i) {
+        printf("%d%s", g_order[i], i+1<N ? " " : "\n");
+    }
+    c = ct_alloc_canceller();
+    ct_for(HUGE_N, cancel_at_once, c, c);
+    ct_free_canceller(c);
+    ct_fini();
+    return 0;
+}
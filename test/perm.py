@@ -0,0 +1,33 @@
+# perm: under shuffle, $CT_RAND_REV=1 runs the indexes in the reverse order, and different
+# seeds give different orders; a loop of 2G indexes starts without allocating a permutation.
+# $CT_EXPLORE runs alternate between seeds and their reverse.
+s0, o0, c0 = runtest('perm',CT_SCHED='shuffle',CT_RAND_SEED=5)
+s1, o1, c1 = runtest('perm',CT_SCHED='shuffle',CT_RAND_SEED=5,CT_RAND_REV=1)
+s2, o2, c2 = runtest('perm',CT_SCHED='shuffle',CT_RAND_SEED=6)
+order = o0.split()
+if sorted(map(int,order)) != range(20) or o1.split() != order[::-1] or o2 == o0:
+    fail(c1)
+
+# under pshuffle, a nested loop's order depends on the loop and the index it's nested in,
+# rather than on whether other indexes started their nested loops before it
+if 'pshuffle' in scheds:
+    n0 = runtest('perm','nested 0',CT_SCHED='pshuffle',CT_THREADS=2,CT_RAND_SEED=5)
+    n1 = runtest('perm','nested 1',CT_SCHED='pshuffle',CT_THREADS=2,CT_RAND_SEED=5)
+    rows = n0[1].split('\n')
+    if n0[1] != n1[1] or len(rows) != 2 or rows[0] == rows[1] or sorted(map(int,rows[0].split())) != range(20):
+        fail(n1[2])
+
+# with $CT_EXPLORE, successive runs alternate between a new seed and the reverse of the last run
+state = 'bin/explore.state'
+if os.path.exists(state):
+    os.remove(state)
+runs = [runtest('perm',CT_SCHED='shuffle',CT_EXPLORE=state) for run in range(3)]
+orders = [o.split() for s,o,c in runs]
+if orders[1] != orders[0][::-1] or orders[2] in orders[:2] or 'runs 3' not in open(state).read():
+    fail(runs[2][2])
+
+# runs started at once take turns updating the state file, so none of them is lost
+runcommand('for i in 1 2 3 4 5 6 7 8; do env CT_SCHED=shuffle CT_EXPLORE=%s ./bin/perm & done; wait'%state,
+           expected_status=None)
+if 'runs 11\n' not in open(state).read():
+    fail('concurrent runs with CT_EXPLORE=%s'%state)
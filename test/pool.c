@@ -0,0 +1,69 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "checkedthreads.h"
+
+#define N 100
+#define M 10
+
+int g_array[N][M];
+
+void inner(int index, void* context) {
+    int* row = (int*)context;
+    row[index] += index;
+}
+
+/* the nested loop should inherit the pool of the outer one */
+void outer(int index, void* context) {
+    ct_for(M, inner, g_array[index], 0);
+}
+
+void run_outer(void* arg) {
+    ct_for(N, outer, 0, 0);
+}
+
+void task(void* arg) {
+    outer(*(int*)arg, 0);
+}
+
+int main() {
+    ct_pool* pool;
+    ct_stats pool_stats, default_stats;
+    const char* sched = getenv("CT_SCHED");
+    int i, j;
+    static int k0 = 0, k1 = 1; /* static, so that C89 allows their addresses in the initializer */
+    ct_task tasks[] = {
+        {task, &k0},
+        {task, &k1},
+        {0, 0}
+    };
+
+    ct_init(0);
+    pool = ct_alloc_pool(3);
+    ct_pool_for(pool, N, outer, 0, 0);
+    ct_pool_run(pool, run_outer, 0);
+    ct_pool_invoke(pool, tasks, 0);
+    for(i=0; i<N; ++i) {
+        for(j=0; j<M; ++j) {
+            if(g_array[i][j] != j*(i < 2 ? 3 : 2)) {
+                printf("error at %d,%d!\n", i, j);
+                return 1;
+            }
+        }
+    }
+
+    /* under pthreads, all of the indexes should have run in the pool, and none in the default one */
+    ct_pool_get_stats(pool, &pool_stats, 0, 0);
+    ct_get_stats(&default_stats, 0, 0);
+    if(sched && strcmp(sched, "pthreads") == 0) {
+        unsigned long expected = 2*(N + N*M) + 2 + 2*M;
+        if(pool_stats.indexes != expected || default_stats.indexes != 0) {
+            printf("error: %lu indexes in the pool (expected %lu), %lu in the default pool (expected 0)\n",
+                   pool_stats.indexes, expected, default_stats.indexes);
+            return 1;
+        }
+    }
+    ct_free_pool(pool);
+    ct_fini();
+    return 0;
+}
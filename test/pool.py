@@ -0,0 +1,4 @@
+# pool: loops submitted to a pool - and those nested in them - run there under all schedulers;
+# under pthreads, the pool's statistics show that they didn't run in the default pool.
+for sched in scheds:
+    runtest('pool',CT_SCHED=sched)
@@ -0,0 +1,117 @@
+#include "checkedthreads.h"
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <pthread.h>
+
+/* with a single worker (CT_THREADS=2), we fill the queues while the worker is
+   busy and the loops' submitters are stuck in their first indexes: a normal
+   loop is queued first, and then a high-priority one. once we let the worker
+   go, it should take the high-priority loop before the normal one, though
+   it's behind it in the order of submission. the other threads stay stuck
+   until the worker picks a loop, so that none of them takes a queued loop
+   first - the outcome doesn't depend on timing.
+
+   with "nested", the high-priority loop has a single index, which runs the
+   N-index loop with the default priority - which it should inherit. */
+
+enum { NONE, NORMAL, HIGH };
+
+const int N = 64;
+volatile int g_release = 0; /* lets the worker go */
+volatile int g_blocking_started = 0;
+volatile int g_normal_started = 0;
+volatile int g_high_started = 0;
+pthread_t g_blocker; /* the thread submitting the loop which keeps the worker busy */
+pthread_t g_worker;
+bool g_nested = false;
+volatile int g_worker_first = NONE; /* the loop the worker took first once released */
+
+void wait_for(volatile int& flag) {
+    while(!flag) {
+        usleep(100);
+    }
+}
+
+void first_index(int loop) {
+    if(pthread_equal(pthread_self(), g_worker)) {
+        __sync_val_compare_and_swap(&g_worker_first, NONE, loop);
+    }
+}
+
+void* blocking(void*) {
+    g_blocker = pthread_self();
+    ctx_for(2, [](int) {
+        if(pthread_equal(pthread_self(), g_blocker)) {
+            __sync_fetch_and_add(&g_blocking_started, 1);
+            wait_for(g_worker_first);
+        }
+        else {
+            g_worker = pthread_self();
+            __sync_fetch_and_add(&g_blocking_started, 1);
+            wait_for(g_release);
+        }
+    });
+    return 0;
+}
+
+void* normal(void*) {
+    ctx_for(N, [](int i) {
+        if(i == 0) {
+            g_normal_started = 1;
+            wait_for(g_worker_first);
+        }
+        first_index(NORMAL);
+    });
+    return 0;
+}
+
+void high_loop(int priority) {
+    ctx_for(N, [](int i) {
+        if(i == 0) {
+            g_high_started = 1;
+            wait_for(g_worker_first);
+        }
+        first_index(HIGH);
+    }, 0, priority);
+}
+
+void* high(void*) {
+    if(g_nested) {
+        ctx_for(1, [](int) {
+            high_loop(CT_PRIO_DEFAULT);
+        }, 0, CT_PRIO_HIGH);
+    }
+    else {
+        high_loop(CT_PRIO_HIGH);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    g_nested = argc > 1 && strcmp(argv[1], "nested") == 0;
+    ct_init(0);
+    pthread_t normal_thread, high_thread;
+
+    pthread_create(&g_blocker, 0, blocking, 0);
+    while(g_blocking_started < 2) {
+        usleep(100);
+    }
+    pthread_create(&normal_thread, 0, normal, 0);
+    wait_for(g_normal_started);
+    pthread_create(&high_thread, 0, high, 0);
+    wait_for(g_high_started);
+    g_release = 1;
+
+    pthread_join(g_blocker, 0);
+    pthread_join(normal_thread, 0);
+    pthread_join(high_thread, 0);
+    ct_fini();
+
+    if(g_worker_first != HIGH) {
+        printf("the worker took the %s loop first, rather than the high-priority one queued after it%s\n",
+               g_worker_first == NORMAL ? "normal-priority" : "(no)", g_nested ? " (nested)" : "");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,7 @@
+# prio: only pthreads has priority classes. with a single worker and the queues filled while
+# it's busy, it should take the high-priority loop before the normal one queued ahead of it -
+# also when the loop is nested in a high-priority loop's index, and inherits its priority.
+if 'prio' in built:
+    for spin in ['0','adaptive']:
+        for mode in ['','nested']:
+            runtest('prio',mode,CT_SCHED='pthreads',CT_THREADS=2,CT_SPIN_USEC=spin)
@@ -1,4 +1,4 @@
 for sched in scheds:
-    if sched not in 'serial shuffle valgrind'.split():
+    if sched not in 'serial shuffle valgrind fork'.split():
         runtest('sleep',CT_SCHED=sched)
 
@@ -0,0 +1,89 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "checkedthreads.h"
+
+#define N 1000
+#define MAX_WORKERS 256
+#define SUBMITTERS 4
+#define SUBMITTED_LOOPS 200
+
+void index_callback(int index, void* context) {
+    int* array = (int*)context;
+    array[index] = index;
+}
+
+/* threads outside the pool, submitting loops all at once */
+void* submitter(void* arg) {
+    int* array = (int*)arg;
+    int i;
+    for(i=0; i<SUBMITTED_LOOPS; ++i) {
+        ct_for(N, index_callback, array, 0);
+    }
+    return 0;
+}
+
+int main(int argc, char** argv) {
+    int array[N]={0};
+    ct_stats total, per_worker[MAX_WORKERS];
+    unsigned long indexes = 0, expected = N;
+    int i, num_workers;
+    const char* stats_file = getenv("CT_STATS_FILE");
+
+    ct_init(0);
+    ct_for(N, index_callback, array, 0);
+    if(argc > 1 && strcmp(argv[1], "submitters") == 0) {
+        pthread_t threads[SUBMITTERS];
+        int arrays[SUBMITTERS][N];
+        for(i=0; i<SUBMITTERS; ++i) {
+            pthread_create(&threads[i], 0, submitter, arrays[i]);
+        }
+        for(i=0; i<SUBMITTERS; ++i) {
+            pthread_join(threads[i], 0);
+        }
+        expected += SUBMITTERS*SUBMITTED_LOOPS*N;
+    }
+    num_workers = ct_get_stats(&total, per_worker, MAX_WORKERS);
+    if(num_workers == 0) { /* a serial scheduler */
+        if(total.indexes != 0) {
+            printf("error: no workers but %lu indexes\n", total.indexes);
+            return 1;
+        }
+    }
+    else {
+        for(i=0; i<num_workers && i<MAX_WORKERS; ++i) {
+            indexes += per_worker[i].indexes;
+        }
+        if(total.indexes != expected || indexes != expected) {
+            printf("error: %lu indexes run but the total is %lu and the per-worker sum is %lu\n",
+                    expected, total.indexes, indexes);
+            return 1;
+        }
+        if(total.items == 0 || total.busy_sec < 0) {
+            printf("error: %lu items, %f seconds busy\n", total.items, total.busy_sec);
+            return 1;
+        }
+    }
+    if(stats_file && num_workers) {
+        ct_stats_file_header header;
+        FILE* f = fopen(stats_file, "rb");
+        if(!f || fread(&header, sizeof header, 1, f) != 1) {
+            printf("error: can't read %s\n", stats_file);
+            return 1;
+        }
+        fclose(f);
+        if(header.magic != CT_STATS_MAGIC || header.num_workers != num_workers) {
+            printf("error: bad header in %s\n", stats_file);
+            return 1;
+        }
+    }
+    for(i=0; i<N; ++i) {
+        if(array[i] != i) {
+            printf("error at %d!\n", i);
+            return 1;
+        }
+    }
+    ct_fini();
+    return 0;
+}
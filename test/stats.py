@@ -0,0 +1,10 @@
+# stats: the parallel schedulers should count every index; publishing to a file shouldn't change that.
+# (stats is a C program, and tbb is only in the C++ library, so it would just run the default scheduler.)
+for sched in scheds:
+    if sched != 'tbb':
+        runtest('stats',CT_SCHED=sched)
+if with_pthreads:
+    runtest('stats',CT_SCHED='pthreads',CT_STATS_FILE='bin/stats.shm')
+# threads outside the pool submitting loops concurrently all count as worker 0, and mustn't lose counts
+if with_pthreads:
+    runtest('stats','submitters',CT_SCHED='pthreads')
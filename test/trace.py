@@ -0,0 +1,40 @@
+# trace: $CT_TRACE should produce a well-formed Chrome trace with an event per loop,
+# and under the parallel schedulers, per-thread slices covering all of its indexes
+import json
+for sched in scheds:
+    if sched == 'tbb': # hello_ct is a C program, and tbb is only in the C++ library
+        continue
+    s, o, c = runtest('hello_ct',expected_output=hello_output,CT_SCHED=sched,CT_TRACE='bin/trace.json')
+    try:
+        events = json.load(open('bin/trace.json'))['traceEvents']
+        if len([e for e in events if e['name'] == 'ct_for']) != 1:
+            fail(c)
+    except (IOError, ValueError, KeyError):
+        fail(c)
+
+# with several workers: the JSON is still valid, every index shows up in exactly one
+# per-thread slice (chunk or steal events), more than one thread gets some, and each
+# thread's events are recorded as they end, so their end times never go back.
+def check_slices(events, n):
+    slices = [e for e in events if e['name'] in ('chunk','steal')]
+    threads = set([e['tid'] for e in slices if e['args']['indexes'] > 0])
+    if sum([e['args']['indexes'] for e in slices]) != n or len(threads) < 2:
+        return False
+    for tid in set([e['tid'] for e in events]):
+        ends = [e['ts'] + e['dur'] for e in events if e['tid'] == tid and e['ph'] == 'X']
+        if [e for e in events if e['tid'] == tid and e['ph'] == 'X' and (e['ts'] < 0 or e['dur'] < 0)]:
+            return False
+        if [i for i in range(1,len(ends)) if ends[i] < ends[i-1] - 0.01]: # the times are rounded to 0.001
+            return False
+    return True
+
+if 'sleep' in built:
+    for sched in scheds:
+        if sched not in ('pthreads','openmp'):
+            continue
+        s, o, c = runtest('sleep',CT_SCHED=sched,CT_THREADS=4,OMP_NUM_THREADS=4,CT_TRACE='bin/trace.json')
+        try:
+            if not check_slices(json.load(open('bin/trace.json'))['traceEvents'], 50):
+                fail(c)
+        except (IOError, ValueError, KeyError):
+            fail(c)
@@ -0,0 +1,317 @@
+/* drives the Valgrind tool without Valgrind: valgrind/checkedthreads_main.c is
+   compiled against the stub headers in valgrind/stubs, and fed a random sequence
+   of loops, iterations, accesses and allocations through its client requests,
+   its malloc replacement functions and its access tracing function - the calls
+   the checkedthreads runtime and the instrumented code make under Valgrind.
+   compiled with -DCT_MODEL, it feeds the same sequence to test/valgrind_model.h
+   instead; test/valgrind_driver.py compares the two.
+
+   usage: valgrind_driver STEPS SEED [--sites] [tool options]
+
+   --sites gives each address region a call stack of its own, rather than every
+   access a distinct one, so that repeated errors are reported once. */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+
+#ifdef CT_MODEL
+#include "valgrind_model.h"
+#else
+#include "../valgrind/checkedthreads_main.c"
+
+static int g_drv_sites = 0;
+static UWord g_drv_site = 0;
+static UWord g_drv_stack_id = 0;
+static Addr g_drv_block = 0; /* what VG_(cli_malloc) returns */
+static SizeT g_drv_block_size = 0; /* and VG_(malloc_usable_size) */
+
+/* the Valgrind core, as far as the tool needs it */
+void VG_(tool_panic)(const Char* str) { printf("checkedthreads: panic - %s\n", str); exit(1); }
+UInt VG_(printf)(const HChar* format, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, format);
+    n = vprintf(format, ap);
+    va_end(ap);
+    return (UInt)n;
+}
+UInt VG_(umsg)(const HChar* format, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, format);
+    n = vprintf(format, ap);
+    va_end(ap);
+    return (UInt)n;
+}
+UInt VG_(sprintf)(Char* buf, const HChar* format, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, format);
+    n = vsprintf(buf, format, ap);
+    va_end(ap);
+    return (UInt)n;
+}
+UInt VG_(snprintf)(Char* buf, Int size, const HChar* format, ...)
+{
+    va_list ap;
+    int n;
+    va_start(ap, format);
+    n = vsnprintf(buf, size, format, ap);
+    va_end(ap);
+    return (UInt)n;
+}
+Int VG_(strcmp)(const Char* s1, const Char* s2) { return strcmp(s1, s2); }
+Int VG_(strncmp)(const Char* s1, const Char* s2, SizeT nmax) { return strncmp(s1, s2, nmax); }
+SizeT VG_(strlen)(const Char* str) { return strlen(str); }
+Long VG_(strtoll10)(Char* str, Char** endptr) { return strtoll(str, endptr, 10); }
+void* VG_(memset)(void* s, Int c, SizeT sz) { return memset(s, c, sz); }
+void* VG_(memcpy)(void* d, const void* s, SizeT sz) { return memcpy(d, s, sz); }
+Int VG_(memcmp)(const void* s1, const void* s2, SizeT n) { return memcmp(s1, s2, n); }
+Int VG_(getpid)(void) { return 1234; }
+UInt VG_(read_millisecond_timer)(void) { return 0; }
+Addr VG_(thread_get_stack_max)(ThreadId tid) { return 0; }
+SizeT VG_(thread_get_stack_size)(ThreadId tid) { return 0; }
+void* VG_(fnptr_to_fnentry)(void* f) { return f; }
+void* VG_(malloc)(HChar* cc, SizeT nbytes) { return malloc(nbytes); }
+void* VG_(calloc)(HChar* cc, SizeT n, SizeT bytes_per_elem) { return calloc(n, bytes_per_elem); }
+void* VG_(realloc)(HChar* cc, void* p, SizeT size) { return realloc(p, size); }
+void VG_(free)(void* p) { free(p); }
+void* VG_(cli_malloc)(SizeT align, SizeT nbytes) { return (void*)g_drv_block; }
+void VG_(cli_free)(void* p) {}
+SizeT VG_(malloc_usable_size)(void* p) { return g_drv_block_size; }
+UInt VG_(clo_alignment) = 16;
+ThreadId VG_(get_running_tid)(void) { return 1; }
+UInt VG_(get_StackTrace)(ThreadId tid, StackTrace ips, UInt n_ips, StackTrace sps, StackTrace fps,
+                         Word first_ip_delta)
+{
+    ips[0] = g_drv_sites ? g_drv_site : ++g_drv_stack_id;
+    return 1;
+}
+void VG_(pp_StackTrace)(StackTrace ips, UInt n_ips) { printf("  <stack>\n"); }
+void VG_(get_and_pp_StackTrace)(ThreadId tid, UInt n_ips) { printf("  <stack>\n"); }
+const DebugInfo* VG_(next_DebugInfo)(const DebugInfo* di) { return 0; }
+Addr VG_(DebugInfo_get_got_avma)(const DebugInfo* di) { return 0; }
+SizeT VG_(DebugInfo_get_got_size)(const DebugInfo* di) { return 0; }
+Addr VG_(DebugInfo_get_plt_avma)(const DebugInfo* di) { return 0; }
+SizeT VG_(DebugInfo_get_plt_size)(const DebugInfo* di) { return 0; }
+Addr VG_(DebugInfo_get_gotplt_avma)(const DebugInfo* di) { return 0; }
+SizeT VG_(DebugInfo_get_gotplt_size)(const DebugInfo* di) { return 0; }
+/* quotes and backslashes, for checking that --json=yes escapes them */
+Char* VG_(describe_IP)(Addr eip, Char* buf, Int n_buf)
+{
+    snprintf(buf, n_buf, "0x%lX: site \"%lu\" in C:\\valgrind_driver.c", eip, eip);
+    return buf;
+}
+void VG_(discard_translations)(Addr64 start, ULong range, HChar* who) {}
+void VG_(details_name)(Char* name) {}
+void VG_(details_version)(Char* version) {}
+void VG_(details_description)(Char* description) {}
+void VG_(details_copyright_author)(Char* copyright_author) {}
+void VG_(details_bug_reports_to)(Char* bug_reports_to) {}
+void VG_(details_avg_translation_sizeB)(UInt size) {}
+void VG_(basic_tool_funcs)(void (*post_clo_init)(void),
+                           IRSB* (*instrument)(VgCallbackClosure*, IRSB*, VexGuestLayout*, VexGuestExtents*,
+                                               IRType, IRType),
+                           void (*fini)(Int)) {}
+void VG_(needs_command_line_options)(Bool (*process_cmd_line_option)(Char*),
+                                     void (*print_usage)(void),
+                                     void (*print_debug_usage)(void)) {}
+void VG_(needs_client_requests)(Bool (*handle_client_request)(ThreadId, UWord*, UWord*)) {}
+void VG_(needs_malloc_replacement)(void* (*malloc)(ThreadId, SizeT),
+                                   void* (*builtin_new)(ThreadId, SizeT),
+                                   void* (*builtin_vec_new)(ThreadId, SizeT),
+                                   void* (*memalign)(ThreadId, SizeT, SizeT),
+                                   void* (*calloc)(ThreadId, SizeT, SizeT),
+                                   void (*free)(ThreadId, void*),
+                                   void (*builtin_delete)(ThreadId, void*),
+                                   void (*builtin_vec_delete)(ThreadId, void*),
+                                   void* (*realloc)(ThreadId, void*, SizeT),
+                                   SizeT (*malloc_usable_size)(ThreadId, void*),
+                                   SizeT client_malloc_redzone_szB) {}
+void VG_(track_new_mem_mmap)(void (*f)(Addr a, SizeT len, Bool rr, Bool ww, Bool xx, ULong di_handle)) {}
+void VG_(track_die_mem_munmap)(void (*f)(Addr a, SizeT len)) {}
+
+/* VEX - nothing is instrumented here */
+IRSB* deepCopyIRSBExceptStmts(IRSB* bb) { VG_(tool_panic)("no IR"); return 0; }
+void addStmtToIRSB(IRSB* bb, IRStmt* st) { VG_(tool_panic)("no IR"); }
+IRTemp newIRTemp(IRTypeEnv* env, IRType ty) { VG_(tool_panic)("no IR"); return 0; }
+IRStmt* IRStmt_WrTmp(IRTemp tmp, IRExpr* data) { VG_(tool_panic)("no IR"); return 0; }
+IRStmt* IRStmt_Dirty(IRDirty* details) { VG_(tool_panic)("no IR"); return 0; }
+IRExpr* IRExpr_Binop(UInt op, IRExpr* arg1, IRExpr* arg2) { VG_(tool_panic)("no IR"); return 0; }
+IRExpr* IRExpr_Load(UInt end, IRType ty, IRExpr* addr) { VG_(tool_panic)("no IR"); return 0; }
+IRExpr* IRExpr_Const(IRConst* con) { VG_(tool_panic)("no IR"); return 0; }
+IRExpr* IRExpr_RdTmp(IRTemp tmp) { VG_(tool_panic)("no IR"); return 0; }
+IRConst* IRConst_U8(UChar u8) { VG_(tool_panic)("no IR"); return 0; }
+IRExpr* mkIRExpr_HWord(HWord hw) { VG_(tool_panic)("no IR"); return 0; }
+IRExpr** mkIRExprVec_2(IRExpr* arg1, IRExpr* arg2) { VG_(tool_panic)("no IR"); return 0; }
+IRDirty* unsafeIRDirty_0_N(Int regparms, HChar* name, void* addr, IRExpr** args) { VG_(tool_panic)("no IR"); return 0; }
+Bool isIRAtom(IRExpr* e) { VG_(tool_panic)("no IR"); return False; }
+Bool eqIRAtom(IRExpr* a1, IRExpr* a2) { VG_(tool_panic)("no IR"); return False; }
+Int sizeofIRType(IRType ty) { VG_(tool_panic)("no IR"); return 0; }
+IRType typeOfIRExpr(IRTypeEnv* tyenv, IRExpr* e) { VG_(tool_panic)("no IR"); return 0; }
+IRType typeOfIRTemp(IRTypeEnv* env, IRTemp tmp) { VG_(tool_panic)("no IR"); return 0; }
+
+/* the driver's interface, as the runtime and the instrumented code talk to the tool */
+
+static UWord drv_request(UWord request, UWord arg1, UWord arg2)
+{
+    UWord args[3], ret = 0;
+    args[0] = request;
+    args[1] = arg1;
+    args[2] = arg2;
+    if(!ct_handle_client_request(1, args, &ret)) {
+        VG_(tool_panic)("client request not handled");
+    }
+    return ret;
+}
+
+static void drv_init(int argc, char** argv)
+{
+    int i;
+    VG_(tool_pre_clo_init)();
+    for(i=0; i<argc; ++i) {
+        if(strcmp(argv[i], "--sites") == 0) {
+            g_drv_sites = 1;
+        }
+        else if(!ct_process_cmd_line_option(argv[i])) {
+            printf("bad option: %s\n", argv[i]);
+            exit(1);
+        }
+    }
+    ct_post_clo_init();
+}
+
+static unsigned long drv_granule(void) { return 1UL << g_ct_granule_bits; }
+static void drv_begin(void) { drv_request(CT_REQ_BEGIN_FOR, 0, 0); }
+static void drv_end(void) { drv_request(CT_REQ_END_FOR, 0, 0); }
+static void drv_iter(int thread, int index) { drv_request(CT_REQ_ITER, thread-1, index); }
+static void drv_done(void) { drv_request(CT_REQ_DONE, 0, 0); }
+
+static void drv_access(unsigned long a, unsigned long size, int store)
+{
+    g_drv_site = 1 + (a >> 20);
+    if(store) {
+        trace_store(a, size);
+    }
+    else {
+        trace_load(a, size);
+    }
+}
+
+static void drv_malloc(unsigned long a, unsigned long size)
+{
+    g_drv_block = a;
+    ct_malloc(1, size);
+}
+
+static void drv_free(unsigned long a, unsigned long size)
+{
+    g_drv_block_size = size;
+    ct_free(1, (void*)a);
+}
+
+static void drv_realloc(unsigned long a, unsigned long old_size, unsigned long new_size)
+{
+    g_drv_block_size = old_size;
+    if(ct_realloc(1, (void*)a, new_size) != (void*)a) {
+        VG_(tool_panic)("a shrinking block was moved");
+    }
+}
+
+static int drv_owner(unsigned long a) { return (int)(Word)drv_request(CT_REQ_GET_OWNER, a, 0); }
+static void drv_fini(void) { ct_fini(0); }
+#endif
+
+static unsigned long long g_rand = 88172645463325252ULL;
+static unsigned long rnd(void)
+{
+    g_rand ^= g_rand << 13;
+    g_rand ^= g_rand >> 7;
+    g_rand ^= g_rand << 17;
+    return (unsigned long)g_rand;
+}
+
+#define MAX_DEPTH_RUN 6
+#define NUM_THREADS 6
+
+int main(int argc, char** argv)
+{
+    unsigned long regions[] = { 0x10000000, 0x10003000, 0x7ff00000, 0x200000 };
+    unsigned long sizes[] = { 1, 2, 4, 8, 16, 32, 3, 100, 5000, 20000 };
+    unsigned long granule;
+    int steps, depth, i, index = 0;
+    if(argc < 3) {
+        printf("usage: %s STEPS SEED [--sites] [tool options]\n", argv[0]);
+        return 1;
+    }
+    steps = atoi(argv[1]);
+    g_rand += 0x9E3779B97F4A7C15ULL * atoi(argv[2]);
+    drv_init(argc-3, argv+3);
+    granule = drv_granule(); /* accesses are aligned to granules, so that the byte-level model agrees */
+
+    drv_begin();
+    drv_iter(1 + rnd()%NUM_THREADS, index++);
+    depth = 1;
+    for(i=0; i<steps; ++i) {
+        int op = rnd() % 100;
+        unsigned long a = regions[rnd()%4] + rnd()%0x5000;
+        a &= ~(granule-1);
+        if(op < 4 && depth < MAX_DEPTH_RUN) {
+            drv_begin();
+            drv_iter(1 + rnd()%NUM_THREADS, index++);
+            printf("begin %d\n", ++depth);
+        }
+        else if(op < 8 && depth > 1) {
+            drv_done();
+            drv_end();
+            printf("end %d\n", --depth);
+        }
+        else if(op < 18) {
+            drv_done();
+            drv_iter(1 + rnd()%NUM_THREADS, index++);
+        }
+        else if(op < 86) {
+            unsigned long size = (sizes[rnd()%(op < 80 ? 8 : 10)] + granule-1) & ~(granule-1);
+            int store = rnd()%2;
+            printf("%s %lx %lu\n", store ? "store" : "load", a, size);
+            drv_access(a, size, store);
+        }
+        else if(op < 92) {
+            /* large blocks - over 16 pages - are kept as ranges */
+            unsigned long size = rnd()%3 ? sizes[rnd()%10] : rnd()%0x14000 + 1;
+            size = (size + granule-1) & ~(granule-1);
+            if(op < 88) {
+                printf("malloc %lx %lu\n", a, size);
+                drv_malloc(a, size);
+            }
+            else if(op < 90) {
+                printf("free %lx %lu\n", a, size);
+                drv_free(a, size);
+            }
+            else {
+                unsigned long new_size = (rnd()%(size+1)) & ~(granule-1);
+                printf("realloc %lx %lu -> %lu\n", a, size, new_size);
+                drv_realloc(a, size, new_size);
+            }
+        }
+        else {
+            int k;
+            printf("owners %lx:", a);
+            for(k=0; k<64; k+=granule) {
+                printf(" %d", drv_owner(a+k));
+            }
+            printf("\n");
+        }
+    }
+    while(depth > 0) {
+        drv_done();
+        drv_end();
+        --depth;
+    }
+    drv_fini();
+    return 0;
+}
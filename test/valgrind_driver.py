@@ -0,0 +1,86 @@
+# valgrind_driver: the Valgrind tool's shadow memory and error reporting, built
+# without Valgrind against valgrind/stubs and driven by test/valgrind_driver.c.
+# the tool should report the same errors as the naive model in test/valgrind_model.h,
+# per byte and with --granularity=8, and its reporting options should do what they say.
+import re
+import json
+
+driver_cc = 'gcc -std=gnu99 -O1 -g -w test/valgrind_driver.c'
+driver_steps = 20000
+unlimited = '--max-reports=1000000000'
+
+def driver(args,binary='valgrind_driver'):
+    return runcommand('./bin/%s %d %s'%(binary,driver_steps,args))
+
+def error_lines(output):
+    return [line for line in output.split('\n') if line.startswith('checkedthreads: error - ')]
+
+def without_summary(output):
+    '''the driver's trace and the errors, without the tool's messages at startup and exit'''
+    return '\n'.join([line for line in output.split('\n') if not line.startswith('checkedthreads: ') or \
+                      line.startswith('checkedthreads: error - ')])
+
+def totals(output):
+    '''errors in all, reported and not reported, from the text summary'''
+    m = re.search(r'checkedthreads: (\d+) errors in all, (\d+) reported, (\d+) not reported',output)
+    return [int(n) for n in m.groups()] if m else None
+
+failures = len(failed)
+s1, o1, c1 = runcommand(driver_cc+' -I valgrind/stubs -o bin/valgrind_driver')
+s2, o2, c2 = runcommand(driver_cc+' -DCT_MODEL -o bin/valgrind_model')
+if s1 == 0 and s2 == 0:
+    # the tool against the model
+    for seed in [1,2,3]:
+        for gran in ['','--granularity=8']:
+            s, o, c = driver('%d %s %s'%(seed,gran,unlimited))
+            sm, om, cm = driver('%d %s'%(seed,gran),binary='valgrind_model')
+            if without_summary(o) != om or not error_lines(om):
+                fail(c)
+
+    # a race is reported once per loop and call stack, and its repeats are counted
+    s, o, c = driver('1 --sites '+unlimited)
+    t = totals(o)
+    repeats = [int(n) for n in re.findall(r'repeated (\d+) times',o)]
+    if not t or not repeats or t[2] != 0 or len(error_lines(o)) != t[1] or t[0] != t[1] + sum(repeats) - len(repeats):
+        fail(c)
+    text_errors = [re.match(r'.*thread (\d+) accessed (\S+) .*owned by (\d+)',line).groups() for line in error_lines(o)]
+
+    # --json=yes reports the same errors as objects, one per line
+    s, o, c = driver('1 --sites --json=yes '+unlimited)
+    try:
+        objects = [json.loads(line) for line in o.split('\n') if line.startswith('{')]
+        errors = [obj for obj in objects if obj['kind'] == 'error']
+        counts = [obj['count'] for obj in objects if obj['kind'] == 'summary']
+        total = [obj for obj in objects if obj['kind'] == 'total'][0]
+        if [(str(e['thread']),e['address'],str(e['owner'])) for e in errors] != text_errors or \
+           len(counts) != total['reports'] or sum(counts) + total['unreported'] != total['errors'] or \
+           not errors[0]['stack'][0].endswith(r'site "%d" in C:\valgrind_driver.c'%int(errors[0]['stack'][0].split(':')[0],16)):
+            fail(c)
+    except (ValueError,KeyError,IndexError):
+        fail(c)
+
+    # --max-reports stops reporting, but not counting
+    s, o, c = driver('1 --max-reports=5')
+    t = totals(o)
+    if len(error_lines(o)) != 5 or 'checkedthreads: 5 errors reported - not reporting any more' not in o or \
+       not t or t[1] != 5 or t[2] == 0 or t[0] != 5 + t[2]:
+        fail(c)
+
+    # sampling everything is the same as not sampling; sampling less reports less, the same
+    # way for the same seed; sampling nothing reports nothing
+    s, full, c = driver('2 '+unlimited)
+    s, o, c = driver('2 --sample-iterations=100 --sample-pages=100 '+unlimited)
+    if o != full:
+        fail(c)
+    half = '2 --sample-iterations=50 --sample-pages=50 --sample-seed=7 '+unlimited
+    s, o1, c = driver(half)
+    s, o2, c = driver(half)
+    m = re.search(r'checked (\d+) of (\d+) iterations \(--sample-seed=7\)',o1)
+    if o1 != o2 or not m or not 0 < int(m.group(1)) < int(m.group(2)) or \
+       not 0 < len(error_lines(o1)) < len(error_lines(full)):
+        fail(c)
+    s, o, c = driver('2 --sample-pages=0 '+unlimited)
+    if error_lines(o):
+        fail(c)
+    if verbose and len(failed) == failures:
+        print ' ','the Valgrind tool agrees with the model and its reporting options work'
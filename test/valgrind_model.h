@@ -0,0 +1,126 @@
+/* a naive reference model of the Valgrind tool's ownership rules, for
+   test/valgrind_driver.c: every byte of the few address regions the driver uses
+   has an owner per nesting level, and a level's owners are looked up through
+   its parents'. the tool should report exactly the errors the model reports. */
+
+#define OWNER_INACCESSIBLE 0xff
+#define REGION_SIZE 0x20000
+#define MODEL_BYTES (3*REGION_SIZE)
+#define MAX_DEPTH 64
+
+typedef struct {
+    short owner[MODEL_BYTES]; /* -1: not written at this level */
+    char dirty[MODEL_BYTES];
+    int spawner;
+} model_level;
+
+static model_level* g_levels[MAX_DEPTH];
+static int g_depth = 0;
+static int g_thread = 0;
+static unsigned long g_granule = 1;
+
+static int model_index(unsigned long a)
+{
+    if(a >= 0x200000 && a < 0x200000+REGION_SIZE) return a-0x200000;
+    if(a >= 0x10000000 && a < 0x10000000+REGION_SIZE) return REGION_SIZE + a-0x10000000;
+    if(a >= 0x7ff00000 && a < 0x7ff00000+REGION_SIZE) return 2*REGION_SIZE + a-0x7ff00000;
+    printf("model: bad address %lx\n", a);
+    exit(1);
+}
+
+/* the owner seen at a level: its own, or its parent's - where the spawner's
+   ownership is inherited, so nobody owns those bytes at this level */
+static int model_view(int level, int i)
+{
+    int owner;
+    if(g_levels[level]->owner[i] >= 0) return g_levels[level]->owner[i];
+    if(level == 0) return 0;
+    owner = model_view(level-1, i);
+    return owner == g_levels[level]->spawner ? 0 : owner;
+}
+
+static void model_access(unsigned long base, unsigned long size, int store, int report_errors)
+{
+    model_level* l = g_levels[g_depth-1];
+    unsigned long k;
+    for(k=0; k<size; ++k) {
+        int i = model_index(base+k), owner = model_view(g_depth-1, i);
+        if(report_errors && owner && owner != g_thread) {
+            printf("checkedthreads: error - thread %d accessed %p [%p,%d], owned by %d\n",
+                   g_thread-1, (void*)(base+k), (void*)base, (int)size, owner-1);
+            printf("  <stack>\n");
+            break;
+        }
+        if(store) {
+            l->owner[i] = g_thread;
+            if(g_thread) l->dirty[i] = 1;
+        }
+    }
+}
+
+static void model_mark(unsigned long start, unsigned long end, int owner)
+{
+    int thread = g_thread;
+    g_thread = owner;
+    model_access(start, end-start, 1, 0);
+    g_thread = thread;
+}
+
+/* the driver's interface */
+
+static void drv_init(int argc, char** argv)
+{
+    int i;
+    for(i=0; i<argc; ++i) {
+        if(strcmp(argv[i], "--granularity=8") == 0) g_granule = 8;
+    }
+}
+
+static unsigned long drv_granule(void) { return g_granule; }
+
+static void drv_begin(void)
+{
+    model_level* l = (model_level*)malloc(sizeof(model_level));
+    int i;
+    for(i=0; i<MODEL_BYTES; ++i) {
+        l->owner[i] = -1;
+        l->dirty[i] = 0;
+    }
+    l->spawner = g_thread;
+    g_levels[g_depth++] = l;
+}
+
+/* the bytes written in a loop are owned by the spawner once it's over */
+static void drv_end(void)
+{
+    model_level* l = g_levels[--g_depth];
+    int i;
+    g_thread = l->spawner;
+    if(g_depth > 0) {
+        model_level* parent = g_levels[g_depth-1];
+        for(i=0; i<MODEL_BYTES; ++i) {
+            if(l->dirty[i]) {
+                parent->owner[i] = l->owner[i] == OWNER_INACCESSIBLE ? OWNER_INACCESSIBLE : g_thread;
+                parent->dirty[i] = 1;
+            }
+        }
+    }
+    free(l);
+}
+
+static void drv_iter(int thread, int index) { g_thread = thread; }
+static void drv_done(void) {}
+static void drv_access(unsigned long a, unsigned long size, int store) { model_access(a, size, store, 1); }
+static void drv_malloc(unsigned long a, unsigned long size) { model_mark(a, a+size, g_thread); }
+static void drv_free(unsigned long a, unsigned long size) { model_mark(a, a+size, OWNER_INACCESSIBLE); }
+
+/* shrinking in place: the rest of the block, from the next granule, becomes inaccessible */
+static void drv_realloc(unsigned long a, unsigned long old_size, unsigned long new_size)
+{
+    unsigned long rest = (a + new_size + g_granule - 1) & ~(g_granule - 1);
+    model_mark(a, a+new_size, g_thread);
+    model_mark(rest, a+old_size, OWNER_INACCESSIBLE);
+}
+
+static int drv_owner(unsigned long a) { return model_view(g_depth-1, model_index(a)) - 1; }
+static void drv_fini(void) {}
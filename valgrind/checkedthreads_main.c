@@ -24,7 +24,8 @@
 #include "pub_tool_threadstate.h"
 #include "pub_tool_stacktrace.h"
 #include "pub_tool_debuginfo.h"
-#include <stdint.h>
+#include "pub_tool_libcproc.h"     // VG_(getpid), VG_(read_millisecond_timer)
+#include "pub_tool_transtab.h"     // VG_(discard_translations)
 
 /*------------------------------------------------------------*/
 /*--- Command line options                                 ---*/
@@ -34,10 +35,50 @@
  * the top of this file. */
 static Bool clo_trace_mem       = True;
 static Bool clo_print_commands  = False;
+static Bool clo_stats           = False;
+static Bool clo_instrument_serial = False;
+static Long clo_serial_threshold_ms = 50;
+static Long clo_granularity     = 1;
+static Bool clo_json            = False;
+static Long clo_max_reports     = 1000;
+static Long clo_sample_iterations = 100; /* percent */
+static Long clo_sample_pages    = 100; /* percent */
+static Long clo_sample_seed     = -1; /* -1: the process ID */
+
+/* ownership is tracked per granule of 2^g_ct_granule_bits bytes. */
+static Int g_ct_granule_bits = 0;
 
 static Bool ct_process_cmd_line_option(Char* arg)
 {
    if VG_BOOL_CLO(arg, "--print-commands", clo_print_commands) {}
+   else if VG_BOOL_CLO(arg, "--stats", clo_stats) {}
+   else if VG_BOOL_CLO(arg, "--instrument-serial", clo_instrument_serial) {}
+   else if VG_BOOL_CLO(arg, "--json", clo_json) {}
+   else if VG_INT_CLO(arg, "--serial-threshold-ms", clo_serial_threshold_ms) {
+      if (clo_serial_threshold_ms < 0)
+         return False;
+   }
+   else if VG_INT_CLO(arg, "--max-reports", clo_max_reports) {
+      if (clo_max_reports < 0)
+         return False;
+   }
+   else if VG_INT_CLO(arg, "--sample-iterations", clo_sample_iterations) {
+      if (clo_sample_iterations < 0 || clo_sample_iterations > 100)
+         return False;
+   }
+   else if VG_INT_CLO(arg, "--sample-pages", clo_sample_pages) {
+      if (clo_sample_pages < 0 || clo_sample_pages > 100)
+         return False;
+   }
+   else if VG_INT_CLO(arg, "--sample-seed", clo_sample_seed) {
+      if (clo_sample_seed < 0)
+         return False;
+   }
+   else if VG_INT_CLO(arg, "--granularity", clo_granularity) {
+      if (clo_granularity != 1 && clo_granularity != 8)
+         return False;
+      g_ct_granule_bits = clo_granularity == 8 ? 3 : 0;
+   }
    else
       return False;
    return True;
@@ -48,6 +89,26 @@ static void ct_print_usage(void)
    VG_(printf)(
 "    --print-commands=no|yes   print commands issued by the checkedtheads\n"
 "                              runtime [no]\n"
+"    --stats=no|yes            print shadow memory statistics at exit [no]\n"
+"    --granularity=1|8         track ownership per byte or per 8 bytes; 8 takes\n"
+"                              less memory, but misses races within a word [1]\n"
+"    --instrument-serial=no|yes  instrument code running outside any loop, too;\n"
+"                              saves retranslating code in programs running\n"
+"                              many short loops one after another [no]\n"
+"    --serial-threshold-ms=<ms>  stop instrumenting serial code only after a\n"
+"                              serial phase at least this long; shorter ones\n"
+"                              run instrumented, saving the retranslation.\n"
+"                              0 stops after every outermost loop [50]\n"
+"    --json=no|yes             report errors as JSON objects, one per line [no]\n"
+"    --max-reports=<number>    stop reporting new errors (but keep counting\n"
+"                              them) after this many were reported [1000]\n"
+"    --sample-iterations=<percent>  check this share of loop iterations, chosen\n"
+"                              at random; the rest only record their stores [100]\n"
+"    --sample-pages=<percent>  check this share of memory pages, chosen at\n"
+"                              random [100]\n"
+"    --sample-seed=<number>    the seed choosing the iterations and pages; it's\n"
+"                              printed, and the same seed checks the same ones\n"
+"                              [the process ID]\n"
    );
 }
 
@@ -78,9 +139,10 @@ typedef
 
 /* Up to this many unnotified events are allowed.  Must be at least two,
    so that reads and writes to the same address can be merged into a modify.
-   Beyond that, larger numbers just potentially induce more spilling due to
-   extending live ranges of address temporaries. */
-#define N_EVENTS 4
+   Beyond that, larger numbers potentially induce more spilling due to
+   extending live ranges of address temporaries - but the events flushed
+   together share a single load of g_ct_active guarding their helper calls. */
+#define N_EVENTS 8
 
 /* Maintain an ordered list of memory events which are outstanding, in
    the sense that no IR has yet been generated to do the relevant
@@ -111,21 +173,20 @@ typedef
 static Event events[N_EVENTS];
 static Int   events_used = 0;
 
-#define MAGIC 0x12345678
-#define CONST_MAGIC "Valgrind command"
-#define MAX_CMD 128
-
-typedef struct {
-    volatile uint32_t stored_magic;
-    const char const_magic[16];
-    volatile char payload[MAX_CMD];
-} ct_cmd;
-
-static ct_cmd* g_ct_last_cmd = 0; /* ignore writes to cmd */
+/* client requests sent by the checkedthreads runtime; must match the
+   enum in src/valgrind_imp.c. */
+typedef enum {
+    CT_REQ_BEGIN_FOR = VG_USERREQ_TOOL_BASE('C','T'), /* arg1: stackbot */
+    CT_REQ_END_FOR,
+    CT_REQ_ITER, /* arg1: thread, arg2: index */
+    CT_REQ_DONE, /* arg1: index */
+    CT_REQ_GET_OWNER /* arg1: address; returns owner-1 */
+} ct_request;
 
 /* 3-level page table; up to 2^36 pages of 2^12 bytes each,
-   organized into levels of up to 2^12 entries each.
-   should work fine for virtual addresses of up to 48 bits. */
+   organized into levels of up to 2^12 entries each, covering
+   virtual addresses of up to 48 bits. (a 2-level table would need
+   a 2^18-entry top level, allocated anew at every nesting level.) */
 #define PAGE_BITS 12
 #define PAGE_SIZE (1<<PAGE_BITS)
 #define L1_BITS 12
@@ -135,26 +196,52 @@ static ct_cmd* g_ct_last_cmd = 0; /* ignore writes to cmd */
 #define L3_BITS 12
 #define NUM_L2_PAGETABS (1<<L3_BITS)
 
-#define L2_PAGETAB(addr) ((((UInt)addr >> 24) >> 12) & 0xfff)
-#define L1_PAGETAB(addr) (((UInt)addr >> 24) & 0xfff)
-#define PAGE(addr) (((UInt)addr >> 12) & 0xfff)
-#define BYTE_IN_PAGE(addr) ((UInt)addr & 0xfff)
+#define L2_PAGETAB(addr) (((Addr)(addr) >> 36) & 0xfff)
+#define L1_PAGETAB(addr) (((Addr)(addr) >> 24) & 0xfff)
+#define PAGE(addr) (((Addr)(addr) >> 12) & 0xfff)
+#define BYTE_IN_PAGE(addr) ((UInt)((Addr)(addr) & 0xfff))
+
+/* each page table keeps a direct-mapped cache of recently looked up pages,
+   so that most lookups skip the walk. pages live as long as their table,
+   so entries never go stale. */
+#define PAGE_CACHE_BITS 6
+#define PAGE_CACHE_SIZE (1<<PAGE_CACHE_BITS)
+#define PAGE_CACHE_SLOT(addr) (((Addr)(addr) >> PAGE_BITS) & (PAGE_CACHE_SIZE-1))
+
+#define GRANULES_PER_PAGE ((SizeT)PAGE_SIZE >> g_ct_granule_bits)
+#define GRANULE_IN_PAGE(addr) (BYTE_IN_PAGE(addr) >> g_ct_granule_bits)
+
+#define WORD_BYTES sizeof(UWord)
+#define WORD_BITS (8*WORD_BYTES)
+#define DIRTY_BYTES (GRANULES_PER_PAGE / 8)
 
 #define OWNER_INACCESSIBLE 0xff /* inaccessible memory - "owned" by thread 255 which is never the current thread. */
 
 /* owning_thread[] is a summary of all levels up to this one; if
    owning_thread[i]==0, perhaps indeed the location is owned by nobody -
    and perhaps it's owned by a thread who spawned the current for.
-
-   dirty_owners[i], if non-zero, is always equal to owning_thread[i]
-   (since they're updated simultaneously), and it means that the ownership
-   was obtained in the current for, and must be committed to the spawner's
-   page table when this for quits. */
+   while all of a page has the same owner (as is the case for most pages),
+   owning_thread is 0 and the owner is kept in uniform_owner.
+
+   a page with different owners isn't copied from the spawner's table when
+   a nested for first touches it; rather, it points to the spawner's page,
+   and is only copied when first written (the spawner's table doesn't change
+   while a nested for runs.)
+
+   a dirty bit means that the ownership of the granule was obtained in the
+   current for, and must be committed to the spawner's page table when this
+   for quits. (the owner thus obtained is always the one in owning_thread,
+   since they're updated simultaneously.) */
 typedef struct ct_page_ {
     /* 0 means "owned by none" (so is OK to access).
        the rest means "owned by i" (so is OK to access for i only.) */
-    unsigned char owning_thread[PAGE_SIZE];
-    unsigned char* dirty_owners; /* PAGE_SIZE entries, when allocated. */
+    unsigned char* owning_thread; /* GRANULES_PER_PAGE entries, or 0 if uniform. */
+    unsigned char uniform_owner;
+    /* if non-0, owning_thread is 0, and the owners are those of inherited->owning_thread,
+       except for spawner_thread, which is replaced with 0. */
+    struct ct_page_* inherited;
+    unsigned char spawner_thread;
+    UWord* dirty; /* a bit per granule, when allocated. */
     Addr base_address;
     /* we keep a linked a list of allocated pages so as to not have
        to traverse all indexes to find allocated pages. */
@@ -165,54 +252,306 @@ typedef struct ct_pagetab_L1_ {
     ct_page* pages[NUM_PAGES];
     ct_page* last_alloc_page; /* head of allocated pages list */
     struct ct_pagetab_L1_* prev_alloc_pagetab_L1;
+    UInt index; /* in pagetabs_L1[] */
 } ct_pagetab_L1;
 
 typedef struct ct_pagetab_L2_ {
     ct_pagetab_L1* pagetabs_L1[NUM_L1_PAGETABS];
     ct_pagetab_L1* last_alloc_pagetab_L1;
     struct ct_pagetab_L2_* prev_alloc_pagetab_L2;
+    UInt index; /* in pagetabs_L2[] */
 } ct_pagetab_L2;
 
+/* the ownership of a large block allocated or freed in a for is kept as a
+   range rather than written to every page it spans; pages created later apply
+   the ranges, in the order they were set, to their owners. pages existing when
+   a range is set are updated at once. */
+#define MIN_RANGE_PAGES 16
+
+typedef struct ct_range_ {
+    Addr start, end;
+    int owner;
+    struct ct_range_* next;
+} ct_range;
+
 typedef struct ct_pagetab_L3_ {
     ct_pagetab_L2* pagetabs_L2[NUM_L2_PAGETABS];
     ct_pagetab_L2* last_alloc_pagetab_L2;
+    SizeT num_pages;
+    ct_range* first_range; /* oldest first */
+    ct_page* page_cache[PAGE_CACHE_SIZE];
+    /* the spawner's table and thread; ownership not obtained in this for
+       is looked up in the parent table. */
+    struct ct_pagetab_L3_* parent;
+    int spawner_thread;
+    ULong loop; /* the for's serial number, for error reports */
 } ct_pagetab_L3;
 
 typedef struct ct_pagetab_stack_entry_ {
     ct_pagetab_L3* pagetab_L3;
     int thread;
     int active;
+    int checking;
     char* stackbot;
+    char* stackend;
     struct ct_pagetab_stack_entry_* next_stack_entry;
 } ct_pagetab_stack_entry;
 
 static Bool g_ct_active = False;
+/* False in an iteration left out by --sample-iterations: its stores are
+   recorded, so that the iterations checked see the locations it owns, but
+   nothing is checked. */
+static Bool g_ct_checking = True;
+/* code translated while no loop is running is not instrumented at all */
+static Bool g_ct_instrumenting = False;
+/* the serial phases - the time between outermost loops, in
+   VG_(read_millisecond_timer) time: when the current one started, and how
+   long the last one took. program startup is the first serial phase. */
+static UInt g_ct_serial_start_ms = 0;
+static UInt g_ct_serial_ms = 0;
 static ct_pagetab_stack_entry* g_ct_pagetab_stack = 0;
 static ct_pagetab_L3* g_ct_pagetab_L3 = 0; /* top/curr pagetab */
 static Int g_ct_curr_thread = 0; /* top/curr thread */
 static char* g_ct_stackbot = 0;
 static char* g_ct_stackend = 0;
 
+/* --stats counters */
+static ULong g_ct_lookups = 0;
+static ULong g_ct_lookup_walks = 0;
+static ULong g_ct_pages_allocated = 0;
+static ULong g_ct_allocator_calls = 0;
+static ULong g_ct_loops = 0;
+static ULong g_ct_retranslations = 0;
+static ULong g_ct_iterations = 0;
+static ULong g_ct_iterations_checked = 0;
+static SizeT g_ct_shadow_bytes = 0;
+static SizeT g_ct_shadow_peak = 0;
+
+/* shadow memory objects of each kind are allocated from a slab allocator,
+   and go to its free list rather than back to Valgrind's allocator - loops
+   of many small iterations push and pop page tables all the time.
+
+   objects are zeroed when a slab is allocated, and are kept zeroed on the
+   free list (save for the link in their first word) by clearing whatever
+   was set before freeing them - except for owners arrays, which are always
+   written in full. */
+typedef struct {
+    HChar* name;
+    SizeT size;
+    SizeT per_slab;
+    void* free_list;
+} ct_slab;
+
+static ct_slab g_ct_page_slab = { "page", sizeof(ct_page), 64, 0 };
+static ct_slab g_ct_pagetab_L1_slab = { "pagetab_L1", sizeof(ct_pagetab_L1), 1, 0 };
+static ct_slab g_ct_pagetab_L2_slab = { "pagetab_L2", sizeof(ct_pagetab_L2), 1, 0 };
+static ct_slab g_ct_pagetab_L3_slab = { "pagetab_L3", sizeof(ct_pagetab_L3), 1, 0 };
+static ct_slab g_ct_stack_entry_slab = { "pagetab_stack_entry", sizeof(ct_pagetab_stack_entry), 64, 0 };
+static ct_slab g_ct_range_slab = { "range", sizeof(ct_range), 64, 0 };
+/* sized by --granularity, at ct_post_clo_init */
+static ct_slab g_ct_owners_slab = { "owning_thread", 0, 16, 0 };
+static ct_slab g_ct_dirty_slab = { "dirty", 0, 64, 0 };
+
+static void* ct_slab_alloc(ct_slab* slab)
+{
+    void* p = slab->free_list;
+    if(!p) {
+        char* objects = (char*)VG_(calloc)(slab->name, slab->per_slab, slab->size);
+        SizeT i;
+        ++g_ct_allocator_calls;
+        for(i=0; i<slab->per_slab; ++i) {
+            p = objects + i*slab->size;
+            *(void**)p = slab->free_list;
+            slab->free_list = p;
+        }
+    }
+    slab->free_list = *(void**)p;
+    *(void**)p = 0;
+    /* the peak shadow memory is that of the objects in use */
+    g_ct_shadow_bytes += slab->size;
+    if(g_ct_shadow_bytes > g_ct_shadow_peak) {
+        g_ct_shadow_peak = g_ct_shadow_bytes;
+    }
+    return p;
+}
+
+static void ct_slab_free(ct_slab* slab, void* p)
+{
+    g_ct_shadow_bytes -= slab->size;
+    *(void**)p = slab->free_list;
+    slab->free_list = p;
+}
+
+static inline int ct_owner_at(ct_page* page, SizeT granule)
+{
+    if(page->owning_thread) {
+        return page->owning_thread[granule];
+    }
+    if(page->inherited) {
+        int owner = page->inherited->owning_thread[granule];
+        /* it's OK to access the spawner's locations */
+        return owner == page->spawner_thread ? 0 : owner;
+    }
+    return page->uniform_owner;
+}
+
+/* the index of the first of owners[from..n) not owned by owner, or n. */
+static SizeT ct_find_other_owner(const unsigned char* owners, SizeT from, SizeT n, int owner)
+{
+    SizeT i = from;
+    UWord same = (UWord)owner * (~(UWord)0 / 0xff);
+    while(i < n && ((Addr)&owners[i] % WORD_BYTES)) {
+        if(owners[i] != owner) return i;
+        ++i;
+    }
+    while(i + WORD_BYTES <= n && *(const UWord*)&owners[i] == same) {
+        i += WORD_BYTES;
+    }
+    while(i < n && owners[i] == owner) {
+        ++i;
+    }
+    return i;
+}
+
+/* gives the page its own owner per granule (copied from the inherited page, if any.) */
+static unsigned char* ct_owners(ct_page* page)
+{
+    if(!page->owning_thread) {
+        unsigned char* owners = (unsigned char*)ct_slab_alloc(&g_ct_owners_slab);
+        if(page->inherited) {
+            const unsigned char* spawner_owners = page->inherited->owning_thread;
+            int spawner_thread = page->spawner_thread;
+            SizeT i;
+            for(i=0; i<GRANULES_PER_PAGE; ++i) {
+                int spawner_owner = spawner_owners[i];
+                /* don't copy the spawner's ownership - it's OK to access that location */
+                owners[i] = spawner_owner != spawner_thread ? spawner_owner : 0;
+            }
+            page->inherited = 0;
+        }
+        else {
+            VG_(memset)(owners, page->uniform_owner, GRANULES_PER_PAGE);
+        }
+        page->owning_thread = owners;
+    }
+    return page->owning_thread;
+}
+
+/* goes back to a single owner if all granules have the same one. */
+static void ct_compact_owners(ct_page* page)
+{
+    unsigned char* owners = page->owning_thread;
+    if(owners && ct_find_other_owner(owners, 0, GRANULES_PER_PAGE, owners[0]) == GRANULES_PER_PAGE) {
+        page->uniform_owner = owners[0];
+        page->owning_thread = 0;
+        ct_slab_free(&g_ct_owners_slab, owners);
+    }
+}
+
+static inline Bool ct_is_dirty(ct_page* page, SizeT granule)
+{
+    return page->dirty && (page->dirty[granule / WORD_BITS] >> (granule % WORD_BITS)) & 1;
+}
+
+/* the first dirty granule at or after from, or GRANULES_PER_PAGE; skips clean words at once. */
+static SizeT ct_next_dirty(ct_page* page, SizeT from)
+{
+    while(from < GRANULES_PER_PAGE) {
+        UWord bits = page->dirty[from / WORD_BITS] >> (from % WORD_BITS);
+        if(bits) {
+            while(!(bits & 1)) {
+                bits >>= 1;
+                ++from;
+            }
+            return from;
+        }
+        from = (from / WORD_BITS + 1) * WORD_BITS;
+    }
+    return GRANULES_PER_PAGE;
+}
+
+static void ct_set_dirty(ct_page* page, SizeT from, SizeT n)
+{
+    SizeT end = from + n;
+    UWord* dirty = page->dirty;
+    if(!dirty) {
+        dirty = page->dirty = (UWord*)ct_slab_alloc(&g_ct_dirty_slab);
+    }
+    while(from < end && from % WORD_BITS) {
+        dirty[from / WORD_BITS] |= (UWord)1 << (from % WORD_BITS);
+        ++from;
+    }
+    while(from + WORD_BITS <= end) {
+        dirty[from / WORD_BITS] = ~(UWord)0;
+        from += WORD_BITS;
+    }
+    while(from < end) {
+        dirty[from / WORD_BITS] |= (UWord)1 << (from % WORD_BITS);
+        ++from;
+    }
+}
+
+/* makes thread the owner of n granules starting at from, marking them dirty. */
+static void ct_set_owner(ct_page* page, SizeT from, SizeT n, int thread)
+{
+    if(n == GRANULES_PER_PAGE) {
+        if(page->owning_thread) {
+            ct_slab_free(&g_ct_owners_slab, page->owning_thread);
+            page->owning_thread = 0;
+        }
+        page->inherited = 0;
+        page->uniform_owner = thread;
+    }
+    else if(page->owning_thread || page->inherited || page->uniform_owner != thread) {
+        VG_(memset)(&ct_owners(page)[from], thread, n);
+    }
+    if(thread) {
+        ct_set_dirty(page, from, n);
+    }
+}
+
+/* makes thread the owner of the part of [start,end) within the page. */
+static void ct_set_owner_in(ct_page* page, Addr start, Addr end, int thread)
+{
+    Addr page_end = page->base_address + PAGE_SIZE;
+    SizeT from = start <= page->base_address ? 0 : GRANULE_IN_PAGE(start);
+    SizeT to = end >= page_end ? GRANULES_PER_PAGE : GRANULE_IN_PAGE(end-1) + 1;
+    ct_set_owner(page, from, to - from, thread);
+}
+
+static void ct_apply_ranges(ct_page* page, ct_pagetab_L3* pagetab_L3)
+{
+    Addr page_end = page->base_address + PAGE_SIZE;
+    ct_range* range;
+    for(range = pagetab_L3->first_range; range; range = range->next) {
+        if(range->start < page_end && range->end > page->base_address) {
+            ct_set_owner_in(page, range->start, range->end, range->owner);
+        }
+    }
+}
+
 static ct_page* ct_get_page(Addr a, ct_pagetab_L3* pagetab_L3, int readonly_pagetab);
 
-static void ct_init_ownership(ct_page* page)
+static void ct_init_ownership(ct_page* page, ct_pagetab_L3* pagetab_L3)
 {
-    if(g_ct_pagetab_stack == 0 || g_ct_pagetab_stack->pagetab_L3 == 0) {
+    ct_pagetab_L3* parent = pagetab_L3->parent;
+    if(parent == 0) {
         return;
     }
-    ct_page* spawner_page = ct_get_page(page->base_address, g_ct_pagetab_stack->pagetab_L3, 1);
-    if(spawner_page == 0) {
-        return;
+    /* the spawner's page is created if needed, so that ownership obtained further up is seen */
+    ct_page* spawner_page = ct_get_page(page->base_address, parent, 0);
+    int spawner_thread = pagetab_L3->spawner_thread;
+    if(spawner_page->inherited) {
+        ct_owners(spawner_page); /* so that pages are inherited from at most one level up */
     }
-    int spawner_thread = g_ct_pagetab_stack->thread;
-    int i;
-    for(i=0; i<PAGE_SIZE; ++i) {
-        int spawner_owner = spawner_page->owning_thread[i];
-        if(spawner_owner != spawner_thread) {
-            page->owning_thread[i] = spawner_owner;
-        }
-        /* otherwise, don't copy ownership - it's OK to access that location */
+    if(!spawner_page->owning_thread) {
+        int spawner_owner = spawner_page->uniform_owner;
+        /* don't copy the spawner's ownership - it's OK to access that location */
+        page->uniform_owner = spawner_owner != spawner_thread ? spawner_owner : 0;
+        return;
     }
+    page->inherited = spawner_page;
+    page->spawner_thread = spawner_thread;
 }
 
 static ct_page* ct_get_page(Addr a, ct_pagetab_L3* pagetab_L3, int readonly_pagetab)
@@ -220,12 +559,21 @@ static ct_page* ct_get_page(Addr a, ct_pagetab_L3* pagetab_L3, int readonly_page
     ct_pagetab_L2* pagetab_L2;
     ct_pagetab_L1* pagetab_L1;
     ct_page* page;
+    ct_page** cached = &pagetab_L3->page_cache[PAGE_CACHE_SLOT(a)];
+
+    ++g_ct_lookups;
+    page = *cached;
+    if(page && page->base_address == a - BYTE_IN_PAGE(a)) {
+        return page;
+    }
+    ++g_ct_lookup_walks;
 
     UInt pt2_index = L2_PAGETAB(a);
     pagetab_L2 = pagetab_L3->pagetabs_L2[pt2_index];
     if(pagetab_L2 == 0) {
         if(readonly_pagetab) return 0;
-        pagetab_L2 = (ct_pagetab_L2*)VG_(calloc)("pagetab_L2", 1, sizeof(ct_pagetab_L2));
+        pagetab_L2 = (ct_pagetab_L2*)ct_slab_alloc(&g_ct_pagetab_L2_slab);
+        pagetab_L2->index = pt2_index;
         pagetab_L2->prev_alloc_pagetab_L2 = pagetab_L3->last_alloc_pagetab_L2; 
         pagetab_L3->last_alloc_pagetab_L2 = pagetab_L2;
         pagetab_L3->pagetabs_L2[pt2_index] = pagetab_L2;
@@ -235,7 +583,8 @@ static ct_page* ct_get_page(Addr a, ct_pagetab_L3* pagetab_L3, int readonly_page
     pagetab_L1 = pagetab_L2->pagetabs_L1[pt1_index];
     if(pagetab_L1 == 0) {
         if(readonly_pagetab) return 0;
-        pagetab_L1 = (ct_pagetab_L1*)VG_(calloc)("pagetab_L1", 1, sizeof(ct_pagetab_L1));
+        pagetab_L1 = (ct_pagetab_L1*)ct_slab_alloc(&g_ct_pagetab_L1_slab);
+        pagetab_L1->index = pt1_index;
         pagetab_L1->prev_alloc_pagetab_L1 = pagetab_L2->last_alloc_pagetab_L1;
         pagetab_L2->last_alloc_pagetab_L1 = pagetab_L1;
         pagetab_L2->pagetabs_L1[pt1_index] = pagetab_L1;
@@ -245,56 +594,160 @@ static ct_page* ct_get_page(Addr a, ct_pagetab_L3* pagetab_L3, int readonly_page
     page = pagetab_L1->pages[page_index];
     if(page == 0) {
         if(readonly_pagetab) return 0;
-        page = (ct_page*)VG_(calloc)("page", 1, sizeof(ct_page));
+        page = (ct_page*)ct_slab_alloc(&g_ct_page_slab);
         page->base_address = a - BYTE_IN_PAGE(a);
         page->prev_alloc_page = pagetab_L1->last_alloc_page;
         pagetab_L1->last_alloc_page = page;
         pagetab_L1->pages[page_index] = page;
+        ++g_ct_pages_allocated;
+        ++pagetab_L3->num_pages;
 
-        ct_init_ownership(page);
+        ct_init_ownership(page, pagetab_L3);
+        ct_apply_ranges(page, pagetab_L3);
     }
+    *cached = page;
     return page;
 }
 
+/* makes thread the owner of [start,end), marking it dirty - like a store
+   without checking, but taking O(1) time for a large block unless many of
+   its pages were already accessed in this for. */
+static void ct_mark_range(ct_pagetab_L3* pagetab_L3, Addr start, Addr end, int thread)
+{
+    SizeT num_pages;
+    Addr addr;
+    if(end <= start) {
+        return;
+    }
+    num_pages = ((end-1) >> PAGE_BITS) - (start >> PAGE_BITS) + 1;
+    if(num_pages < MIN_RANGE_PAGES) {
+        for(addr = start; addr < end; addr = addr - BYTE_IN_PAGE(addr) + PAGE_SIZE) {
+            ct_set_owner_in(ct_get_page(addr, pagetab_L3, 0), start, end, thread);
+        }
+        return;
+    }
+    /* update the existing pages - looking them up, or walking all of them if there are fewer */
+    if(num_pages <= pagetab_L3->num_pages) {
+        for(addr = start; addr < end; addr = addr - BYTE_IN_PAGE(addr) + PAGE_SIZE) {
+            ct_page* page = ct_get_page(addr, pagetab_L3, 1);
+            if(page) {
+                ct_set_owner_in(page, start, end, thread);
+            }
+        }
+    }
+    else {
+        ct_pagetab_L2* pagetab_L2;
+        ct_pagetab_L1* pagetab_L1;
+        ct_page* page;
+        for(pagetab_L2 = pagetab_L3->last_alloc_pagetab_L2; pagetab_L2; pagetab_L2 = pagetab_L2->prev_alloc_pagetab_L2) {
+            for(pagetab_L1 = pagetab_L2->last_alloc_pagetab_L1; pagetab_L1; pagetab_L1 = pagetab_L1->prev_alloc_pagetab_L1) {
+                for(page = pagetab_L1->last_alloc_page; page; page = page->prev_alloc_page) {
+                    if(page->base_address < end && page->base_address + PAGE_SIZE > start) {
+                        ct_set_owner_in(page, start, end, thread);
+                    }
+                }
+            }
+        }
+    }
+    /* forget the ranges this one overrides, and add it last */
+    ct_range** link = &pagetab_L3->first_range;
+    while(*link) {
+        ct_range* range = *link;
+        if(range->start >= start && range->end <= end) {
+            *link = range->next;
+            VG_(memset)(range, 0, sizeof(ct_range));
+            ct_slab_free(&g_ct_range_slab, range);
+        }
+        else {
+            link = &range->next;
+        }
+    }
+    ct_range* range = (ct_range*)ct_slab_alloc(&g_ct_range_slab);
+    range->start = start;
+    range->end = end;
+    range->owner = thread;
+    *link = range;
+}
+
 static void ct_push_pagetab(void)
 {
-    ct_pagetab_stack_entry* entry = (ct_pagetab_stack_entry*)VG_(calloc)("pagetab_stack_entry", 1, sizeof(ct_pagetab_stack_entry));
+    ct_pagetab_stack_entry* entry = (ct_pagetab_stack_entry*)ct_slab_alloc(&g_ct_stack_entry_slab);
 
     entry->pagetab_L3 = g_ct_pagetab_L3;
     entry->thread = g_ct_curr_thread;
     entry->active = g_ct_active;
+    entry->checking = g_ct_checking;
     entry->stackbot = g_ct_stackbot;
+    entry->stackend = g_ct_stackend;
     entry->next_stack_entry = g_ct_pagetab_stack;
 
     g_ct_pagetab_stack = entry;
 
-    g_ct_pagetab_L3 = (ct_pagetab_L3*)VG_(calloc)("pagetab_L3", 1, sizeof(ct_pagetab_L3));
+    ct_pagetab_L3* pagetab_L3 = (ct_pagetab_L3*)ct_slab_alloc(&g_ct_pagetab_L3_slab);
+    pagetab_L3->parent = g_ct_pagetab_L3;
+    pagetab_L3->spawner_thread = g_ct_curr_thread;
+    pagetab_L3->loop = ++g_ct_loops;
+    g_ct_pagetab_L3 = pagetab_L3;
+}
+
+static inline int ct_joined_owner(int owner, int spawner_thread)
+{
+    /* no matter who owned the location in this loop, the location now
+       is owned by the loop spawner - "joining" means "as if we never forked".
+       inaccessible memory is a special case - it stays inaccessible after the join. */
+    return owner == OWNER_INACCESSIBLE ? owner : spawner_thread;
 }
 
-static void ct_commit_ownership(ct_page* page)
+static void ct_commit_ownership(ct_page* page, ct_pagetab_L3* pagetab_L3)
 {
-    if(!page->dirty_owners || g_ct_pagetab_stack == 0 || g_ct_pagetab_stack->pagetab_L3 == 0) {
+    if(!page->dirty || pagetab_L3->parent == 0) {
         return;
     }
-    /* FIXME: we need parent pointers in page tables or something - instead of these globals...
-       because here, for instance, ct_get_page may fiddle with g_ct_pagetab_stack itself in init_ownership. */
-    ct_page* spawner_page = ct_get_page(page->base_address, g_ct_pagetab_stack->pagetab_L3, 0);
-    if(!spawner_page->dirty_owners) {
-        spawner_page->dirty_owners = VG_(calloc)("dirty_owners", 1, PAGE_SIZE);
+    ct_page* spawner_page = ct_get_page(page->base_address, pagetab_L3->parent, 0);
+    int spawner_thread = pagetab_L3->spawner_thread;
+    /* commit runs of dirty granules with the same joined owner at once, so that
+       a page written in full stays (or becomes) uniform in the spawner's table. */
+    SizeT i = ct_next_dirty(page, 0);
+    while(i < GRANULES_PER_PAGE) {
+        int joined_owner = ct_joined_owner(ct_owner_at(page, i), spawner_thread);
+        SizeT j = i+1;
+        while(j < GRANULES_PER_PAGE && ct_is_dirty(page, j) &&
+              ct_joined_owner(ct_owner_at(page, j), spawner_thread) == joined_owner) {
+            ++j;
+        }
+        ct_set_owner(spawner_page, i, j-i, joined_owner);
+        i = ct_next_dirty(page, j);
     }
-    int curr_thread = g_ct_curr_thread;
-    int i;
-    for(i=0; i<PAGE_SIZE; ++i) {
-        /* no matter who owned the location in this loop, the location now
-           is owned by the loop spawner - "joining" means "as if we never forked" */
-        int owner = page->dirty_owners[i];
-        if(owner) {
-            /* inaccessible memory is a special case - it stays inaccessible after the join. */
-            int joined_owner = owner == OWNER_INACCESSIBLE ? owner : curr_thread;
-            spawner_page->dirty_owners[i] = joined_owner;
-            spawner_page->owning_thread[i] = joined_owner;
+    ct_compact_owners(spawner_page);
+}
+
+/* the owner of addr as seen from pagetab_L3, without creating pages. */
+static int ct_get_owner(Addr addr, ct_pagetab_L3* pagetab_L3)
+{
+    ct_page* page;
+    ct_range* range;
+    int owner;
+    Bool in_range = False;
+    if(pagetab_L3 == 0) {
+        return 0;
+    }
+    page = ct_get_page(addr, pagetab_L3, 1);
+    if(page) {
+        return ct_owner_at(page, GRANULE_IN_PAGE(addr));
+    }
+    /* the last range set wins; a range owns every granule it touches */
+    for(range = pagetab_L3->first_range; range; range = range->next) {
+        if(addr >> g_ct_granule_bits >= range->start >> g_ct_granule_bits &&
+           addr >> g_ct_granule_bits <= (range->end-1) >> g_ct_granule_bits) {
+            owner = range->owner;
+            in_range = True;
         }
     }
+    if(in_range) {
+        return owner;
+    }
+    owner = ct_get_owner(addr, pagetab_L3->parent);
+    return owner == pagetab_L3->spawner_thread ? 0 : owner;
 }
 
 static void ct_pop_pagetab(void)
@@ -304,7 +757,20 @@ static void ct_pop_pagetab(void)
 
     g_ct_curr_thread = g_ct_pagetab_stack->thread;
 
-    /* free all L2 pages */
+    /* commit the ranges first; pages created in this for have applied them,
+       and their dirty granules override them */
+    while(pagetab_L3->first_range) {
+        ct_range* range = pagetab_L3->first_range;
+        if(pagetab_L3->parent && range->owner) {
+            ct_mark_range(pagetab_L3->parent, range->start, range->end,
+                          ct_joined_owner(range->owner, pagetab_L3->spawner_thread));
+        }
+        pagetab_L3->first_range = range->next;
+        VG_(memset)(range, 0, sizeof(ct_range));
+        ct_slab_free(&g_ct_range_slab, range);
+    }
+
+    /* free all L2 pages, clearing just the entries that were used on the way */
     while(pagetab_L2) {
         ct_pagetab_L2* prev_pagetab_L2 = pagetab_L2->prev_alloc_pagetab_L2;
         /* free all L1 pages */
@@ -315,29 +781,52 @@ static void ct_pop_pagetab(void)
             ct_page* page = pagetab_L1->last_alloc_page;
             while(page) {
                 ct_page* prev_page = page->prev_alloc_page;
-                if(page->dirty_owners) {
-                    ct_commit_ownership(page);
-                    VG_(free)(page->dirty_owners);
+                if(page->dirty) {
+                    ct_commit_ownership(page, pagetab_L3);
+                    VG_(memset)(page->dirty, 0, DIRTY_BYTES);
+                    ct_slab_free(&g_ct_dirty_slab, page->dirty);
                 }
-                VG_(free)(page);
+                if(page->owning_thread) {
+                    ct_slab_free(&g_ct_owners_slab, page->owning_thread);
+                }
+                pagetab_L1->pages[PAGE(page->base_address)] = 0;
+                VG_(memset)(page, 0, sizeof(ct_page));
+                ct_slab_free(&g_ct_page_slab, page);
                 page = prev_page;
             }
             /* free the L1 pagetab */
-            VG_(free)(pagetab_L1);
+            pagetab_L2->pagetabs_L1[pagetab_L1->index] = 0;
+            pagetab_L1->last_alloc_page = 0;
+            pagetab_L1->prev_alloc_pagetab_L1 = 0;
+            pagetab_L1->index = 0;
+            ct_slab_free(&g_ct_pagetab_L1_slab, pagetab_L1);
             pagetab_L1 = prev_pagetab_L1;
         }
         /* free the L2 pagetab */
-        VG_(free)(pagetab_L2);
+        pagetab_L3->pagetabs_L2[pagetab_L2->index] = 0;
+        pagetab_L2->last_alloc_pagetab_L1 = 0;
+        pagetab_L2->prev_alloc_pagetab_L2 = 0;
+        pagetab_L2->index = 0;
+        ct_slab_free(&g_ct_pagetab_L2_slab, pagetab_L2);
         pagetab_L2 = prev_pagetab_L2;
     }
-    VG_(free)(pagetab_L3);
+    pagetab_L3->last_alloc_pagetab_L2 = 0;
+    pagetab_L3->num_pages = 0;
+    VG_(memset)(pagetab_L3->page_cache, 0, sizeof(pagetab_L3->page_cache));
+    pagetab_L3->parent = 0;
+    pagetab_L3->spawner_thread = 0;
+    pagetab_L3->loop = 0;
+    ct_slab_free(&g_ct_pagetab_L3_slab, pagetab_L3);
 
     g_ct_pagetab_L3 = g_ct_pagetab_stack->pagetab_L3;
     g_ct_active = g_ct_pagetab_stack->active;
+    g_ct_checking = g_ct_pagetab_stack->checking;
     g_ct_stackbot = g_ct_pagetab_stack->stackbot;
+    g_ct_stackend = g_ct_pagetab_stack->stackend;
 
     ct_pagetab_stack_entry* entry = g_ct_pagetab_stack->next_stack_entry;
-    VG_(free)(g_ct_pagetab_stack);
+    VG_(memset)(g_ct_pagetab_stack, 0, sizeof(ct_pagetab_stack_entry));
+    ct_slab_free(&g_ct_stack_entry_slab, g_ct_pagetab_stack);
     g_ct_pagetab_stack = entry;
 }
 
@@ -347,191 +836,445 @@ static char* ct_stack_end(void)
     return (char*)(VG_(thread_get_stack_max)(tid) - VG_(thread_get_stack_size)(tid));
 }
 
-/* reuse (abuse?) of the page table structure to keep permanently suppressed addresses. */
-static ct_pagetab_L3 g_ct_supp_L3;
+/* the .got, .plt and .got.plt sections of the loaded objects, sorted by address,
+   where writes are made by the dynamic linker and are not races. read from the
+   debug info when first needed after an object was mapped or unmapped. (there's
+   no need for .rodata - nobody owns what nobody can write.) */
+typedef struct {
+    Addr start, end;
+} ct_section;
+
+static ct_section* g_ct_sections = 0;
+static Int g_ct_num_sections = 0;
+static Int g_ct_max_sections = 0;
+static Bool g_ct_sections_stale = True;
+
+static void ct_add_section(Addr start, SizeT size)
+{
+    Int i;
+    if(size == 0) {
+        return;
+    }
+    if(g_ct_num_sections == g_ct_max_sections) {
+        g_ct_max_sections = g_ct_max_sections ? 2*g_ct_max_sections : 64;
+        g_ct_sections = g_ct_sections
+            ? (ct_section*)VG_(realloc)("sections", g_ct_sections, g_ct_max_sections * sizeof(ct_section))
+            : (ct_section*)VG_(malloc)("sections", g_ct_max_sections * sizeof(ct_section));
+    }
+    /* insertion sort; there are a few sections per object */
+    i = g_ct_num_sections++;
+    while(i > 0 && g_ct_sections[i-1].start > start) {
+        g_ct_sections[i] = g_ct_sections[i-1];
+        --i;
+    }
+    g_ct_sections[i].start = start;
+    g_ct_sections[i].end = start + size;
+}
+
+static void ct_load_sections(void)
+{
+    const DebugInfo* di;
+    g_ct_num_sections = 0;
+    for(di = VG_(next_DebugInfo)(NULL); di; di = VG_(next_DebugInfo)(di)) {
+        ct_add_section(VG_(DebugInfo_get_got_avma)(di), VG_(DebugInfo_get_got_size)(di));
+        ct_add_section(VG_(DebugInfo_get_plt_avma)(di), VG_(DebugInfo_get_plt_size)(di));
+        ct_add_section(VG_(DebugInfo_get_gotplt_avma)(di), VG_(DebugInfo_get_gotplt_size)(di));
+    }
+    g_ct_sections_stale = False;
+}
 
-static void ct_suppress_forever(Addr addr)
+static void ct_new_mem_mmap(Addr a, SizeT len, Bool rr, Bool ww, Bool xx, ULong di_handle)
 {
-    ct_pagetab_stack_entry* real_stack = g_ct_pagetab_stack;
-    g_ct_pagetab_stack = 0; //TODO: this is too ugly... prevents "ownership initialization".
-    ct_page* page = ct_get_page(addr, &g_ct_supp_L3, 0); 
-    g_ct_pagetab_stack = real_stack;
+    g_ct_sections_stale = True;
+}
 
-    int index_in_page = BYTE_IN_PAGE(addr);
-    page->owning_thread[index_in_page] = 1; /* in this page table, a non-zero value means "suppressed" */
+static void ct_die_mem_munmap(Addr a, SizeT len)
+{
+    g_ct_sections_stale = True;
 }
 
-static Bool ct_is_supressed_forever(Addr addr)
+static Bool ct_in_section(Addr addr)
 {
-    ct_page* page = ct_get_page(addr, &g_ct_supp_L3, 1);
-    return page && page->owning_thread[BYTE_IN_PAGE(addr)];
+    Int lo = 0, hi;
+    if(g_ct_sections_stale) {
+        ct_load_sections();
+    }
+    /* the last section starting at or before addr */
+    hi = g_ct_num_sections;
+    while(lo < hi) {
+        Int mid = (lo + hi) / 2;
+        if(g_ct_sections[mid].start <= addr) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo > 0 && addr < g_ct_sections[lo-1].end;
 }
 
 static Bool ct_suppress(Addr addr)
 {
     char* p = (char*)addr;
-    /* ignore writes to the stack below stackbot (the point where the ct framework was entered.) */
+    /* ignore writes to the stack below stackbot (the point where the ct framework was entered.)
+       the stack's end is read when a for is entered, and kept per nesting level. */
     if(p >= g_ct_stackend && p < g_ct_stackbot) {
         return True;
     }
-    if(p < g_ct_stackend) { /* perhaps the stack grew in the meanwhile? */
-        g_ct_stackend = ct_stack_end();
-        /* repeat the test */
-        if(p >= g_ct_stackend && p < g_ct_stackbot) {
-            return True;
+    /* ignore changes to .got/.plt/.got.plt */
+    return ct_in_section(addr);
+}
+
+/* errors are reported once per access stack and for (a racy loop over an
+   array makes the same error at every index); repeats are counted, and the
+   range of addresses they accessed is kept for the summary at exit. */
+#define MAX_REPORT_FRAMES 20
+#define REPORT_BUCKETS 1024
+
+typedef struct ct_report_ {
+    ULong loop;
+    Addr ips[MAX_REPORT_FRAMES];
+    UInt num_ips;
+    UInt id;
+    int thread, owner; /* of the first error */
+    Addr first, lo, hi;
+    ULong count;
+    struct ct_report_* next; /* in the bucket */
+    struct ct_report_* next_report; /* in the order of reporting */
+} ct_report;
+
+static ct_report* g_ct_reports[REPORT_BUCKETS];
+static ct_report* g_ct_first_report = 0;
+static ct_report* g_ct_last_report = 0;
+static UInt g_ct_num_reports = 0;
+static ULong g_ct_num_errors = 0;
+static ULong g_ct_unreported_errors = 0;
+
+static void ct_json_string(const Char* str)
+{
+    VG_(printf)("\"");
+    for(; *str; ++str) {
+        if(*str == '"' || *str == '\\') {
+            VG_(printf)("\\%c", *str);
+        }
+        else if((UChar)*str >= ' ') {
+            VG_(printf)("%c", *str);
         }
     }
-    /* ignore permanent suppressions. */
-    if(ct_is_supressed_forever(addr)) {
-        return True;
-    }
-    /* ignore writes to the command object. */
-    if(p >= (char*)g_ct_last_cmd && p < (char*)(g_ct_last_cmd+1)) {
-        ct_suppress_forever(addr);
-        return True;
+    VG_(printf)("\"");
+}
+
+static void ct_print_report(ct_report* report, Addr base, SizeT size)
+{
+    UInt i;
+    if(!clo_json) {
+        VG_(printf)("checkedthreads: error - thread %d accessed %p [%p,%d], owned by %d\n",
+                report->thread-1, (void*)report->first, (void*)base, (int)size, report->owner-1);
+        VG_(pp_StackTrace)(report->ips, report->num_ips);
+        return;
     }
-    /* ignore changes to .got/.plt/.got.plt */
-    VgSectKind kind = VG_(DebugInfo_sect_kind)(NULL, 0, addr);
-    if(kind == Vg_SectGOT || kind == Vg_SectPLT || kind == Vg_SectGOTPLT) {
-        ct_suppress_forever(addr);
-        return True;
+    VG_(printf)("{\"kind\":\"error\",\"id\":%u,\"loop\":%llu,\"thread\":%d,\"address\":\"%p\","
+            "\"access\":\"%p\",\"size\":%d,\"owner\":%d,\"stack\":[",
+            report->id, report->loop, report->thread-1, (void*)report->first,
+            (void*)base, (int)size, report->owner-1);
+    for(i=0; i<report->num_ips; ++i) {
+        Char buf[512];
+        VG_(describe_IP)(report->ips[i], buf, sizeof buf);
+        if(i) VG_(printf)(",");
+        ct_json_string(buf);
     }
+    VG_(printf)("]}\n");
+}
 
-    return False;
+static void ct_report_error(Addr at, Addr base, SizeT size, int owner)
+{
+    Addr ips[MAX_REPORT_FRAMES];
+    UInt num_ips = VG_(get_StackTrace)(VG_(get_running_tid)(), ips, MAX_REPORT_FRAMES, NULL, NULL, 0);
+    ULong loop = g_ct_pagetab_L3->loop;
+    UWord hash = (UWord)loop;
+    ct_report* report;
+    UInt i;
+
+    ++g_ct_num_errors;
+    for(i=0; i<num_ips; ++i) {
+        hash = hash*31 + ips[i];
+    }
+    hash = (hash ^ (hash >> 17)) % REPORT_BUCKETS;
+    for(report = g_ct_reports[hash]; report; report = report->next) {
+        if(report->loop == loop && report->num_ips == num_ips &&
+           VG_(memcmp)(report->ips, ips, num_ips*sizeof(Addr)) == 0) {
+            ++report->count;
+            if(at < report->lo) report->lo = at;
+            if(at > report->hi) report->hi = at;
+            return;
+        }
+    }
+    if(g_ct_num_reports >= clo_max_reports) {
+        if(g_ct_unreported_errors++ == 0 && !clo_json) {
+            VG_(printf)("checkedthreads: %u errors reported - not reporting any more\n", g_ct_num_reports);
+        }
+        return;
+    }
+    report = (ct_report*)VG_(malloc)("report", sizeof(ct_report));
+    report->loop = loop;
+    VG_(memcpy)(report->ips, ips, num_ips*sizeof(Addr));
+    report->num_ips = num_ips;
+    report->id = ++g_ct_num_reports;
+    report->thread = g_ct_curr_thread;
+    report->owner = owner;
+    report->first = report->lo = report->hi = at;
+    report->count = 1;
+    report->next = g_ct_reports[hash];
+    g_ct_reports[hash] = report;
+    report->next_report = 0;
+    if(g_ct_last_report) {
+        g_ct_last_report->next_report = report;
+    }
+    else {
+        g_ct_first_report = report;
+    }
+    g_ct_last_report = report;
+    ct_print_report(report, base, size);
 }
 
-static inline void ct_on_access(Addr base, SizeT size, Bool store, Bool report_errors)
+/* how often each error was repeated, and the total. */
+static void ct_print_report_summary(void)
 {
-    SizeT i;
-    ct_pagetab_L3* pagetab_L3 = g_ct_pagetab_L3;
-    int curr_thread = g_ct_curr_thread;
-    for(i=0; i<size; ++i) {
-        Addr addr = base+i;
-        ct_page* page = ct_get_page(addr, pagetab_L3, 0);
-        int index_in_page = BYTE_IN_PAGE(addr);
-        int owner = page->owning_thread[index_in_page];
-        if(owner && owner != curr_thread) {
-            if(report_errors && !ct_suppress(addr)) {
-                VG_(printf)("checkedthreads: error - thread %d accessed %p [%p,%d], owned by %d\n",
-                        g_ct_curr_thread-1,
-                        (void*)addr, (void*)base, (int)size,
-                        owner-1);
-                VG_(get_and_pp_StackTrace)(VG_(get_running_tid)(), 20);
-                break;
-            }
+    ct_report* report;
+    if(g_ct_num_errors == 0) {
+        return;
+    }
+    for(report = g_ct_first_report; report; report = report->next_report) {
+        if(clo_json) {
+            VG_(printf)("{\"kind\":\"summary\",\"id\":%u,\"count\":%llu,\"lo\":\"%p\",\"hi\":\"%p\"}\n",
+                    report->id, report->count, (void*)report->lo, (void*)report->hi);
         }
-        if(store) {
-            /* update the owner */
-            page->owning_thread[index_in_page] = curr_thread;
-            if(!page->dirty_owners) {
-                page->dirty_owners = (unsigned char*)VG_(calloc)("dirty_owners", 1, PAGE_SIZE);
-            }
-            page->dirty_owners[index_in_page] = curr_thread;
+        else if(report->count > 1) {
+            VG_(printf)("checkedthreads: error at %p (thread %d, loop %llu) repeated %llu times, at [%p,%p]\n",
+                    (void*)report->first, report->thread-1, report->loop, report->count,
+                    (void*)report->lo, (void*)report->hi);
         }
     }
+    if(clo_json) {
+        VG_(printf)("{\"kind\":\"total\",\"errors\":%llu,\"reports\":%u,\"unreported\":%llu}\n",
+                g_ct_num_errors, g_ct_num_reports, g_ct_unreported_errors);
+    }
+    else {
+        VG_(printf)("checkedthreads: %llu errors in all, %u reported, %llu not reported\n",
+                g_ct_num_errors, g_ct_num_reports, g_ct_unreported_errors);
+    }
 }
 
-static Bool ct_str_is(volatile const char* variable, const char* constant)
+/* spawner_thread is 0, or the spawner's thread when looking at an inherited page's owners */
+static inline Bool ct_owner_ok(int owner, int curr_thread, int spawner_thread)
 {
-    int i=0;
-    while(constant[i]) {
-        if(variable[i] != constant[i]) {
-            return False;
+    return owner == 0 || owner == curr_thread || owner == spawner_thread;
+}
+
+/* the index of the first of granules [from,n) owned by a thread other than curr_thread, or n.
+   owner bytes are compared a word at a time; a word where every byte is owned by
+   nobody or by the current thread is either all 0s, all curr_thread, or a mix
+   checked byte by byte. */
+static inline SizeT ct_find_conflict(ct_page* page, SizeT from, SizeT n, int curr_thread)
+{
+    const unsigned char* owners = page->owning_thread;
+    int spawner_thread = 0;
+    SizeT i = from;
+    if(!owners) {
+        if(!page->inherited) {
+            return i < n && !ct_owner_ok(page->uniform_owner, curr_thread, 0) ? i : n;
         }
+        owners = page->inherited->owning_thread;
+        spawner_thread = page->spawner_thread;
+    }
+    UWord ours = (UWord)curr_thread * (~(UWord)0 / 0xff);
+    UWord spawners = (UWord)spawner_thread * (~(UWord)0 / 0xff);
+    while(i < n && ((Addr)&owners[i] % WORD_BYTES)) {
+        if(!ct_owner_ok(owners[i], curr_thread, spawner_thread)) return i;
         ++i;
     }
-    return True;
+    while(i + WORD_BYTES <= n) {
+        UWord w = *(const UWord*)&owners[i];
+        if(w != 0 && w != ours && w != spawners) {
+            SizeT j;
+            for(j=i; j<i+WORD_BYTES; ++j) {
+                if(!ct_owner_ok(owners[j], curr_thread, spawner_thread)) return j;
+            }
+        }
+        i += WORD_BYTES;
+    }
+    while(i < n) {
+        if(!ct_owner_ok(owners[i], curr_thread, spawner_thread)) return i;
+        ++i;
+    }
+    return n;
 }
 
-static Addr ct_cmd_ptr(ct_cmd* cmd, int oft)
+/* --sample-iterations and --sample-pages choose what to check by hashing
+   (loop, index) and page numbers with the seed. */
+static ULong g_ct_sample_seed = 0;
+
+static inline Bool ct_sampled(ULong key, Long percent)
 {
-    return *(Addr*)&cmd->payload[oft];
+    ULong h = key ^ g_ct_sample_seed; /* splitmix64's finalizer */
+    h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+    h ^= h >> 31;
+    return h % 100 < (ULong)percent;
 }
 
-static Int ct_cmd_int(ct_cmd* cmd, int oft)
+static inline Bool ct_page_sampled(Addr addr)
 {
-    return *(volatile int32_t*)&cmd->payload[oft];
+    return clo_sample_pages == 100 ||
+           ct_sampled(((ULong)addr >> PAGE_BITS) * 0x9E3779B97F4A7C15ULL, clo_sample_pages);
 }
 
-static void ct_process_command(ct_cmd* cmd)
+/* an access is split at page boundaries only; each page is looked up once, and its
+   owners are checked and updated as a range of granules. */
+static inline void ct_on_access(Addr base, SizeT size, Bool store, Bool report_errors)
 {
-    if(!ct_str_is(cmd->const_magic, CONST_MAGIC)) {
+    ct_pagetab_L3* pagetab_L3 = g_ct_pagetab_L3;
+    int curr_thread = g_ct_curr_thread;
+    Addr addr = base;
+    Addr end = base + size;
+    if(!g_ct_checking) {
+        if(!store) {
+            return;
+        }
+        report_errors = False;
+    }
+    while(addr < end) {
+        Addr page_end = addr - BYTE_IN_PAGE(addr) + PAGE_SIZE;
+        Addr last = (page_end < end ? page_end : end) - 1;
+        if(!ct_page_sampled(addr)) {
+            /* nobody checks this page, so nobody needs its owners */
+            addr = page_end;
+            continue;
+        }
+        ct_page* page = ct_get_page(addr, pagetab_L3, 0);
+        SizeT first_granule = GRANULE_IN_PAGE(addr);
+        SizeT end_granule = GRANULE_IN_PAGE(last) + 1;
+        Bool reported = False;
+        if(report_errors) {
+            SizeT i = first_granule;
+            while((i = ct_find_conflict(page, i, end_granule, curr_thread)) < end_granule) {
+                Addr at = page->base_address + (i << g_ct_granule_bits);
+                if(at < addr) {
+                    at = addr;
+                }
+                if(!ct_suppress(at)) {
+                    ct_report_error(at, base, size, ct_owner_at(page, i));
+                    /* like a per-byte walk stopping at the error: the bytes before it are updated */
+                    end_granule = i;
+                    reported = True;
+                    break;
+                }
+                ++i;
+            }
+        }
+        if(store && end_granule > first_granule) {
+            ct_set_owner(page, first_granule, end_granule - first_granule, curr_thread);
+        }
+        if(reported) {
+            break;
+        }
+        addr = page_end;
+    }
+}
+
+/* switch between instrumented and uninstrumented translations. the
+   translations made so far are discarded, and the code is translated anew
+   when it next runs; the client request currently being handled ends its
+   superblock, so the rest of the caller's code is retranslated, too.
+   (callgrind discards translations from its client request handler in the
+   same way, when CALLGRIND_START/STOP_INSTRUMENTATION toggle its state.) */
+static void ct_set_instrumenting(Bool on)
+{
+    if(clo_instrument_serial || g_ct_instrumenting == on) {
         return;
     }
-    if(ct_str_is(cmd->payload, "begin_for")) {
+    g_ct_instrumenting = on;
+    ++g_ct_retranslations;
+    VG_(discard_translations)((Addr)0x1000, (ULong)~0xfffUL, "checkedthreads");
+}
+
+static Bool ct_handle_client_request(ThreadId tid, UWord* args, UWord* ret)
+{
+    if(!VG_IS_TOOL_USERREQ('C','T',args[0])) {
+        return False;
+    }
+    switch(args[0]) {
+    case CT_REQ_BEGIN_FOR:
         if(clo_print_commands) VG_(printf)("begin_for\n");
+        if(!g_ct_pagetab_stack) {
+            g_ct_serial_ms = VG_(read_millisecond_timer)() - g_ct_serial_start_ms;
+        }
+        ct_set_instrumenting(True);
         ct_push_pagetab();
-    }
-    else if(ct_str_is(cmd->payload, "end_for")) {
+        g_ct_active = False; /* the runtime's own bookkeeping is not checked */
+        g_ct_stackbot = (char*)args[1];
+        g_ct_stackend = ct_stack_end();
+        if(clo_print_commands) VG_(printf)("stackbot %p [stackend %p]\n",
+                (void*)g_ct_stackbot, (void*)g_ct_stackend);
+        break;
+    case CT_REQ_END_FOR:
         if(clo_print_commands) VG_(printf)("end_for\n");
         ct_pop_pagetab();
         if(clo_print_commands && g_ct_active) VG_(printf)("stackbot restored to %p\n",
                 (void*)g_ct_stackbot);
-    }
-    else if(ct_str_is(cmd->payload, "iter")) {
-        if(clo_print_commands) VG_(printf)("iter %d\n", ct_cmd_int(cmd, 4));
+        /* the next serial phase is guessed to be as long as the last one:
+           only if it's long is it worth retranslating it uninstrumented (and
+           the next loop's code instrumented again.) programs running short
+           loops back to back keep the instrumented translations; a long
+           serial phase after them runs instrumented once, if at all. */
+        if(!g_ct_pagetab_stack) {
+            g_ct_serial_start_ms = VG_(read_millisecond_timer)();
+            if(g_ct_serial_ms >= (UInt)clo_serial_threshold_ms) {
+                ct_set_instrumenting(False);
+            }
+        }
+        break;
+    case CT_REQ_ITER:
+        if(clo_print_commands) VG_(printf)("iter %d\n", (Int)args[2]);
+        g_ct_curr_thread = (Int)args[1]+1;
         g_ct_active = True;
-    }
-    else if(ct_str_is(cmd->payload, "done")) {
-        if(clo_print_commands) VG_(printf)("done %d\n", ct_cmd_int(cmd, 4));
+        ++g_ct_iterations;
+        g_ct_checking = clo_sample_iterations == 100 ||
+                        ct_sampled((g_ct_pagetab_L3->loop << 32) ^ (ULong)args[2], clo_sample_iterations);
+        g_ct_iterations_checked += g_ct_checking;
+        break;
+    case CT_REQ_DONE:
+        if(clo_print_commands) VG_(printf)("done %d\n", (Int)args[1]);
         g_ct_active = False;
+        break;
+    case CT_REQ_GET_OWNER: {
+        int owner = ct_get_owner((Addr)args[1], g_ct_pagetab_L3);
+        *ret = (UWord)(Word)(owner-1);
+        if(clo_print_commands) VG_(printf)("getowner %p -> %d\n", (void*)args[1], owner-1);
+        break;
     }
-    else if(ct_str_is(cmd->payload, "setactiv")) {
-        g_ct_active = (Bool)ct_cmd_int(cmd, 8);
-    }
-    else if(ct_str_is(cmd->payload, "thrd")) {
-        g_ct_curr_thread = ct_cmd_int(cmd, 4)+1;
-    }
-    else if(ct_str_is(cmd->payload, "stackbot")) {
-        g_ct_stackbot = (char*)ct_cmd_ptr(cmd, 8);
-        g_ct_stackend = ct_stack_end();
-        if(clo_print_commands) VG_(printf)("stackbot %p [stackend %p]\n",
-                (void*)g_ct_stackbot, (void*)g_ct_stackend);
+    default:
+        VG_(printf)("checkedthreads: WARNING - unknown client request!\n");
+        VG_(get_and_pp_StackTrace)(tid, 20);
+        return False;
     }
-    else if(ct_str_is(cmd->payload, "getowner")) {
-        Addr addr = ct_cmd_ptr(cmd, 8);
-        int owner = 0;
-        ct_page* page = ct_get_page(addr, g_ct_pagetab_L3, 1);
-        if(page) {
-            int index_in_page = BYTE_IN_PAGE(addr);
-            owner = page->owning_thread[index_in_page];
-        }
-        cmd->stored_magic = owner-1;
-        if(clo_print_commands) VG_(printf)("getowner %p -> %d\n", (void*)addr, owner-1);
-    }
-    else {
-        VG_(printf)("checkedthreads: WARNING - unknown command!\n");
-        VG_(get_and_pp_StackTrace)(VG_(get_running_tid)(), 20);
-    }
-    g_ct_last_cmd = cmd;
+    return True;
 }
 
+/* the helpers are only called while g_ct_active is set - see flushEvents */
 static VG_REGPARM(2) void trace_load(Addr addr, SizeT size)
 {
-    if(g_ct_active) {
-        ct_on_access(addr, size, False, True);
-    }
-}
-
-static inline void ct_on_store(Addr addr, SizeT size)
-{
-   ct_cmd* p = (ct_cmd*)addr;
-   if(p->stored_magic == MAGIC) {
-       ct_process_command(p);
-   }
-   if(g_ct_active) {
-       ct_on_access(addr, size, True, True);
-   }
+    ct_on_access(addr, size, False, True);
 }
 
 static VG_REGPARM(2) void trace_store(Addr addr, SizeT size)
 {
-    ct_on_store(addr, size);
+    ct_on_access(addr, size, True, True);
 }
 
 static VG_REGPARM(2) void trace_modify(Addr addr, SizeT size)
 {
-    ct_on_store(addr, size);
+    ct_on_access(addr, size, True, True);
 }
 
 
@@ -543,6 +1286,7 @@ static void flushEvents(IRSB* sb)
    IRExpr**   argv;
    IRDirty*   di;
    Event*     ev;
+   IRTemp     active = IRTemp_INVALID;
 
    for (i = 0; i < events_used; i++) {
 
@@ -566,12 +1310,23 @@ static void flushEvents(IRSB* sb)
             tl_assert(0);
       }
 
-      // Add the helper.
+      // Add the helper, called only while checking is active.  g_ct_active
+      // can't change in the middle of a superblock - only client requests
+      // change it, and they end their superblock - so it's loaded once.
       if (helperAddr) {
+          if (active == IRTemp_INVALID) {
+             active = newIRTemp( sb->tyenv, Ity_I1 );
+             addStmtToIRSB( sb, IRStmt_WrTmp( active,
+                  IRExpr_Binop( Iop_CmpNE8,
+                     IRExpr_Load( Iend_LE, Ity_I8, // a byte; endianness doesn't matter
+                                  mkIRExpr_HWord( (HWord)&g_ct_active ) ),
+                     IRExpr_Const( IRConst_U8( 0 ) ) ) ) );
+          }
           argv = mkIRExprVec_2( ev->addr, mkIRExpr_HWord( ev->size ) );
           di   = unsafeIRDirty_0_N( /*regparms*/2, 
                   helperName, VG_(fnptr_to_fnentry)( helperAddr ),
                   argv );
+          di->guard = IRExpr_RdTmp( active );
           addStmtToIRSB( sb, IRStmt_Dirty(di) );
       }
    }
@@ -658,6 +1413,14 @@ void addEvent_Dw ( IRSB* sb, IRAtom* daddr, Int dsize )
 
 static void ct_post_clo_init(void)
 {
+    g_ct_instrumenting = clo_instrument_serial;
+    g_ct_sample_seed = clo_sample_seed >= 0 ? (ULong)clo_sample_seed : (ULong)VG_(getpid)();
+    if(clo_sample_iterations < 100 || clo_sample_pages < 100) {
+        VG_(printf)("checkedthreads: checking %lld%% of iterations and %lld%% of pages "
+                "(--sample-seed=%llu)\n", clo_sample_iterations, clo_sample_pages, g_ct_sample_seed);
+    }
+    g_ct_owners_slab.size = GRANULES_PER_PAGE;
+    g_ct_dirty_slab.size = DIRTY_BYTES;
 }
 
 static
@@ -671,6 +1434,11 @@ IRSB* ct_instrument ( VgCallbackClosure* closure,
    IRSB*      sbOut;
    IRTypeEnv* tyenv = sbIn->tyenv;
 
+   /* outside loops, the code runs as is (see ct_set_instrumenting) */
+   if (!g_ct_instrumenting) {
+      return sbIn;
+   }
+
    if (gWordTy != hWordTy) {
       /* We don't currently support this case. */
       VG_(tool_panic)("host/guest word size mismatch");
@@ -806,6 +1574,17 @@ IRSB* ct_instrument ( VgCallbackClosure* closure,
 
 static void ct_fini(Int exitcode)
 {
+    ct_print_report_summary();
+    if(clo_sample_iterations < 100 || clo_sample_pages < 100) {
+        VG_(printf)("checkedthreads: checked %llu of %llu iterations (--sample-seed=%llu)\n",
+                g_ct_iterations_checked, g_ct_iterations, g_ct_sample_seed);
+    }
+    if(clo_stats) {
+        VG_(printf)("checkedthreads: stats - %llu page lookups, %llu table walks, %llu pages allocated, "
+                "%llu peak shadow bytes, %llu allocator calls, %llu loops, %llu retranslations\n",
+                g_ct_lookups, g_ct_lookup_walks, g_ct_pages_allocated, (ULong)g_ct_shadow_peak,
+                g_ct_allocator_calls, g_ct_loops, g_ct_retranslations);
+    }
 }
 
 //dynamic memory: when allocated, set the allocating thread as the owner.
@@ -823,7 +1602,7 @@ static void* alloc_and_record_block(SizeT req_szB, SizeT req_alignB, Bool is_zer
     if (is_zeroed) VG_(memset)(p, 0, req_szB);
 
     if(g_ct_active) {
-        ct_on_access((Addr)p, req_szB, True, False);
+        ct_mark_range(g_ct_pagetab_L3, (Addr)p, (Addr)p + req_szB, g_ct_curr_thread);
     }
 
     return p;
@@ -832,10 +1611,7 @@ static void* alloc_and_record_block(SizeT req_szB, SizeT req_alignB, Bool is_zer
 static void unrecord_block(void* p)
 {
     if(g_ct_active) {
-        int real_curr_thread = g_ct_curr_thread;
-        g_ct_curr_thread = OWNER_INACCESSIBLE;
-        ct_on_access((Addr)p, VG_(malloc_usable_size)(p), True, False);
-        g_ct_curr_thread = real_curr_thread;
+        ct_mark_range(g_ct_pagetab_L3, (Addr)p, (Addr)p + VG_(malloc_usable_size)(p), OWNER_INACCESSIBLE);
     }
 }
 
@@ -886,13 +1662,31 @@ static void ct___builtin_vec_delete ( ThreadId tid, void* p )
 
 static void* ct_realloc ( ThreadId tid, void* p_old, SizeT new_szB )
 {
+    SizeT old_szB = p_old ? VG_(malloc_usable_size)(p_old) : 0;
+    /* a block shrinking (or growing within its usable size) stays in place; it's
+       owned by the current thread as a new block would be, and the rest of it
+       becomes inaccessible. */
+    if(p_old && new_szB <= old_szB && (SSizeT)new_szB >= 0) {
+        if(g_ct_active) {
+            Addr granule = (Addr)1 << g_ct_granule_bits;
+            Addr rest = ((Addr)p_old + new_szB + granule - 1) & ~(granule - 1);
+            ct_mark_range(g_ct_pagetab_L3, (Addr)p_old, (Addr)p_old + new_szB, g_ct_curr_thread);
+            ct_mark_range(g_ct_pagetab_L3, rest, (Addr)p_old + old_szB, OWNER_INACCESSIBLE);
+        }
+        return p_old;
+    }
     void* p_new = alloc_and_record_block(new_szB, VG_(clo_alignment), False);
-    SizeT to_copy = VG_(malloc_usable_size)(p_old);
+    SizeT to_copy = old_szB;
+    if(!p_new) {
+        return NULL;
+    }
     if(to_copy > new_szB) {
         to_copy = new_szB;
     }
-    VG_(memcpy)(p_new, p_old, to_copy);
-    ct_free(tid, p_old);
+    if(p_old) {
+        VG_(memcpy)(p_new, p_old, to_copy);
+        ct_free(tid, p_old);
+    }
     return p_new;
 }
 
@@ -917,6 +1711,9 @@ static void ct_pre_clo_init(void)
    VG_(needs_command_line_options)(ct_process_cmd_line_option,
                                    ct_print_usage,
                                    ct_print_debug_usage);
+   VG_(needs_client_requests)     (ct_handle_client_request);
+   VG_(track_new_mem_mmap)        (ct_new_mem_mmap);
+   VG_(track_die_mem_munmap)      (ct_die_mem_munmap);
    VG_(needs_malloc_replacement)  (ct_malloc,
                                    ct___builtin_new,
                                    ct___builtin_vec_new,
@@ -0,0 +1,32 @@
+/* a stub of Valgrind's pub_tool_basics.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_BASICS_H
+#define CT_STUB_BASICS_H
+
+#include <stddef.h>
+
+typedef unsigned long Addr;
+typedef unsigned long long Addr64;
+typedef unsigned long SizeT;
+typedef long SSizeT;
+typedef unsigned long UWord;
+typedef long Word;
+typedef unsigned long HWord;
+typedef unsigned char UChar;
+typedef unsigned short UShort;
+typedef unsigned int UInt;
+typedef int Int;
+typedef unsigned long long ULong;
+typedef long long Long;
+typedef char Char;
+typedef char HChar;
+typedef unsigned char Bool;
+typedef UInt ThreadId;
+
+#define True ((Bool)1)
+#define False ((Bool)0)
+
+#define VG_(str) vgPlain_##str
+#define VG_REGPARM(n)
+
+#endif
@@ -0,0 +1,17 @@
+/* a stub of Valgrind's pub_tool_debuginfo.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_DEBUGINFO_H
+#define CT_STUB_DEBUGINFO_H
+
+typedef struct _DebugInfo DebugInfo;
+
+const DebugInfo* VG_(next_DebugInfo)(const DebugInfo* di);
+Addr VG_(DebugInfo_get_got_avma)(const DebugInfo* di);
+SizeT VG_(DebugInfo_get_got_size)(const DebugInfo* di);
+Addr VG_(DebugInfo_get_plt_avma)(const DebugInfo* di);
+SizeT VG_(DebugInfo_get_plt_size)(const DebugInfo* di);
+Addr VG_(DebugInfo_get_gotplt_avma)(const DebugInfo* di);
+SizeT VG_(DebugInfo_get_gotplt_size)(const DebugInfo* di);
+Char* VG_(describe_IP)(Addr eip, Char* buf, Int n_buf);
+
+#endif
@@ -0,0 +1,10 @@
+/* a stub of Valgrind's pub_tool_libcassert.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_LIBCASSERT_H
+#define CT_STUB_LIBCASSERT_H
+
+#define tl_assert(expr) ((expr) ? (void)0 : VG_(tool_panic)("assertion failed: " #expr))
+
+void VG_(tool_panic)(const Char* str);
+
+#endif
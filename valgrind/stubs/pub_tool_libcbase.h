@@ -0,0 +1,14 @@
+/* a stub of Valgrind's pub_tool_libcbase.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_LIBCBASE_H
+#define CT_STUB_LIBCBASE_H
+
+Int VG_(strcmp)(const Char* s1, const Char* s2);
+Int VG_(strncmp)(const Char* s1, const Char* s2, SizeT nmax);
+SizeT VG_(strlen)(const Char* str);
+Long VG_(strtoll10)(Char* str, Char** endptr);
+void* VG_(memset)(void* s, Int c, SizeT sz);
+void* VG_(memcpy)(void* d, const void* s, SizeT sz);
+Int VG_(memcmp)(const void* s1, const void* s2, SizeT n);
+
+#endif
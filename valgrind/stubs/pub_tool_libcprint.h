@@ -0,0 +1,11 @@
+/* a stub of Valgrind's pub_tool_libcprint.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_LIBCPRINT_H
+#define CT_STUB_LIBCPRINT_H
+
+UInt VG_(printf)(const HChar* format, ...);
+UInt VG_(sprintf)(Char* buf, const HChar* format, ...);
+UInt VG_(snprintf)(Char* buf, Int size, const HChar* format, ...);
+UInt VG_(umsg)(const HChar* format, ...);
+
+#endif
@@ -0,0 +1,9 @@
+/* a stub of Valgrind's pub_tool_libcproc.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_LIBCPROC_H
+#define CT_STUB_LIBCPROC_H
+
+Int VG_(getpid)(void);
+UInt VG_(read_millisecond_timer)(void);
+
+#endif
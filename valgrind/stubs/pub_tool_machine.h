@@ -0,0 +1,14 @@
+/* a stub of Valgrind's pub_tool_machine.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_MACHINE_H
+#define CT_STUB_MACHINE_H
+
+#define VG_MIN_INSTR_SZB 1
+#define VG_MAX_INSTR_SZB 20
+#define VG_CLREQ_SZB 19
+
+Addr VG_(thread_get_stack_max)(ThreadId tid);
+SizeT VG_(thread_get_stack_size)(ThreadId tid);
+void* VG_(fnptr_to_fnentry)(void* f);
+
+#endif
@@ -0,0 +1,11 @@
+/* a stub of Valgrind's pub_tool_mallocfree.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_MALLOCFREE_H
+#define CT_STUB_MALLOCFREE_H
+
+void* VG_(malloc)(HChar* cc, SizeT nbytes);
+void* VG_(calloc)(HChar* cc, SizeT n, SizeT bytes_per_elem);
+void* VG_(realloc)(HChar* cc, void* p, SizeT size);
+void VG_(free)(void* p);
+
+#endif
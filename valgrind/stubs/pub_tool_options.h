@@ -0,0 +1,22 @@
+/* a stub of Valgrind's pub_tool_options.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_OPTIONS_H
+#define CT_STUB_OPTIONS_H
+
+#include "pub_tool_libcbase.h"
+
+/* like Valgrind's, but without complaining about bad values */
+#define VG_STREQN(n, s1, s2) (VG_(strncmp)((s1), (s2), (n)) == 0)
+#define VG_CLO_VALUE(qq_arg, qq_option) ((qq_arg) + VG_(strlen)(qq_option) + 1)
+#define VG_CLO_MATCHES(qq_arg, qq_option) \
+    (VG_STREQN(VG_(strlen)(qq_option), (qq_arg), (qq_option)) && (qq_arg)[VG_(strlen)(qq_option)] == '=')
+
+#define VG_BOOL_CLO(qq_arg, qq_option, qq_var) \
+    (VG_CLO_MATCHES(qq_arg, qq_option) && \
+     ((qq_var) = VG_(strcmp)(VG_CLO_VALUE(qq_arg, qq_option), "yes") == 0, True))
+
+#define VG_INT_CLO(qq_arg, qq_option, qq_var) \
+    (VG_CLO_MATCHES(qq_arg, qq_option) && \
+     ((qq_var) = VG_(strtoll10)((Char*)VG_CLO_VALUE(qq_arg, qq_option), NULL), True))
+
+#endif
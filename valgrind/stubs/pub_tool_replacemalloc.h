@@ -0,0 +1,12 @@
+/* a stub of Valgrind's pub_tool_replacemalloc.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_REPLACEMALLOC_H
+#define CT_STUB_REPLACEMALLOC_H
+
+void* VG_(cli_malloc)(SizeT align, SizeT nbytes);
+void VG_(cli_free)(void* p);
+SizeT VG_(malloc_usable_size)(void* p);
+
+extern UInt VG_(clo_alignment);
+
+#endif
@@ -0,0 +1,13 @@
+/* a stub of Valgrind's pub_tool_stacktrace.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_STACKTRACE_H
+#define CT_STUB_STACKTRACE_H
+
+typedef Addr* StackTrace;
+
+UInt VG_(get_StackTrace)(ThreadId tid, StackTrace ips, UInt n_ips, StackTrace sps, StackTrace fps,
+                         Word first_ip_delta);
+void VG_(pp_StackTrace)(StackTrace ips, UInt n_ips);
+void VG_(get_and_pp_StackTrace)(ThreadId tid, UInt n_ips);
+
+#endif
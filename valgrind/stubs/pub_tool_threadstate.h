@@ -0,0 +1,8 @@
+/* a stub of Valgrind's pub_tool_threadstate.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_THREADSTATE_H
+#define CT_STUB_THREADSTATE_H
+
+ThreadId VG_(get_running_tid)(void);
+
+#endif
@@ -0,0 +1,118 @@
+/* a stub of Valgrind's pub_tool_tooliface.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_TOOLIFACE_H
+#define CT_STUB_TOOLIFACE_H
+
+/* client requests (valgrind.h) */
+#define VG_USERREQ_TOOL_BASE(a,b) ((UInt)(((a)&0xff) << 24 | ((b)&0xff) << 16))
+#define VG_IS_TOOL_USERREQ(a, b, v) (VG_USERREQ_TOOL_BASE(a,b) == ((v) & 0xffff0000))
+
+/* the IR (libvex_ir.h), just the parts the instrumentation looks at */
+typedef UInt IRType;
+typedef UInt IRTemp;
+#define IRTemp_INVALID ((IRTemp)0xFFFFFFFF)
+enum { Ity_I1 = 0x1100, Ity_I8 };
+enum { Iend_LE = 0x1200 };
+enum { Iop_CmpNE8 = 0x1400 };
+
+typedef struct _IRConst IRConst;
+typedef struct _IRTypeEnv IRTypeEnv;
+
+typedef enum { Iex_Load = 0x1900, Iex_Other } IRExprTag;
+typedef struct _IRExpr IRExpr;
+struct _IRExpr {
+    IRExprTag tag;
+    union {
+        struct { IRType ty; IRExpr* addr; } Load;
+    } Iex;
+};
+
+typedef struct {
+    IRExpr* addr;
+    IRExpr* dataLo;
+    IRExpr* dataHi;
+} IRCAS;
+
+typedef struct {
+    IRExpr* guard;
+} IRDirty;
+
+typedef enum {
+    Ist_NoOp = 0x1E00, Ist_IMark, Ist_AbiHint, Ist_Put, Ist_PutI, Ist_WrTmp, Ist_Store,
+    Ist_CAS, Ist_LLSC, Ist_Dirty, Ist_MBE, Ist_Exit
+} IRStmtTag;
+typedef struct {
+    IRStmtTag tag;
+    union {
+        struct { Addr64 addr; Int len; } IMark;
+        struct { IRTemp tmp; IRExpr* data; } WrTmp;
+        struct { IRExpr* addr; IRExpr* data; } Store;
+        struct { IRCAS* details; } CAS;
+        struct { IRTemp result; IRExpr* addr; IRExpr* storedata; } LLSC;
+    } Ist;
+} IRStmt;
+
+typedef struct {
+    IRTypeEnv* tyenv;
+    IRStmt** stmts;
+    Int stmts_used;
+} IRSB;
+
+typedef struct { Addr64 nraddr; Addr64 readdr; } VgCallbackClosure;
+typedef struct _VexGuestLayout VexGuestLayout;
+typedef struct _VexGuestExtents VexGuestExtents;
+
+IRSB* deepCopyIRSBExceptStmts(IRSB* bb);
+void addStmtToIRSB(IRSB* bb, IRStmt* st);
+IRTemp newIRTemp(IRTypeEnv* env, IRType ty);
+IRStmt* IRStmt_WrTmp(IRTemp tmp, IRExpr* data);
+IRStmt* IRStmt_Dirty(IRDirty* details);
+IRExpr* IRExpr_Binop(UInt op, IRExpr* arg1, IRExpr* arg2);
+IRExpr* IRExpr_Load(UInt end, IRType ty, IRExpr* addr);
+IRExpr* IRExpr_Const(IRConst* con);
+IRExpr* IRExpr_RdTmp(IRTemp tmp);
+IRConst* IRConst_U8(UChar u8);
+IRExpr* mkIRExpr_HWord(HWord hw);
+IRExpr** mkIRExprVec_2(IRExpr* arg1, IRExpr* arg2);
+IRDirty* unsafeIRDirty_0_N(Int regparms, HChar* name, void* addr, IRExpr** args);
+Bool isIRAtom(IRExpr* e);
+Bool eqIRAtom(IRExpr* a1, IRExpr* a2);
+Int sizeofIRType(IRType ty);
+IRType typeOfIRExpr(IRTypeEnv* tyenv, IRExpr* e);
+IRType typeOfIRTemp(IRTypeEnv* env, IRTemp tmp);
+
+/* the tool interface */
+void VG_(details_name)(Char* name);
+void VG_(details_version)(Char* version);
+void VG_(details_description)(Char* description);
+void VG_(details_copyright_author)(Char* copyright_author);
+void VG_(details_bug_reports_to)(Char* bug_reports_to);
+void VG_(details_avg_translation_sizeB)(UInt size);
+
+void VG_(basic_tool_funcs)(void (*post_clo_init)(void),
+                           IRSB* (*instrument)(VgCallbackClosure*, IRSB*, VexGuestLayout*, VexGuestExtents*,
+                                               IRType, IRType),
+                           void (*fini)(Int));
+void VG_(needs_command_line_options)(Bool (*process_cmd_line_option)(Char*),
+                                     void (*print_usage)(void),
+                                     void (*print_debug_usage)(void));
+void VG_(needs_client_requests)(Bool (*handle_client_request)(ThreadId, UWord*, UWord*));
+void VG_(needs_malloc_replacement)(void* (*malloc)(ThreadId, SizeT),
+                                   void* (*builtin_new)(ThreadId, SizeT),
+                                   void* (*builtin_vec_new)(ThreadId, SizeT),
+                                   void* (*memalign)(ThreadId, SizeT, SizeT),
+                                   void* (*calloc)(ThreadId, SizeT, SizeT),
+                                   void (*free)(ThreadId, void*),
+                                   void (*builtin_delete)(ThreadId, void*),
+                                   void (*builtin_vec_delete)(ThreadId, void*),
+                                   void* (*realloc)(ThreadId, void*, SizeT),
+                                   SizeT (*malloc_usable_size)(ThreadId, void*),
+                                   SizeT client_malloc_redzone_szB);
+void VG_(track_new_mem_mmap)(void (*f)(Addr a, SizeT len, Bool rr, Bool ww, Bool xx, ULong di_handle));
+void VG_(track_die_mem_munmap)(void (*f)(Addr a, SizeT len));
+
+/* Valgrind calls the tool's pre_clo_init through this */
+#define VG_DETERMINE_INTERFACE_VERSION(pre_clo_init) \
+    void (*VG_(tool_pre_clo_init))(void) = pre_clo_init;
+
+#endif
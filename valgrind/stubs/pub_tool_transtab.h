@@ -0,0 +1,8 @@
+/* a stub of Valgrind's pub_tool_transtab.h, declaring just what checkedthreads_main.c uses,
+   for building the tool as an ordinary program (see test/valgrind_driver.c) */
+#ifndef CT_STUB_TRANSTAB_H
+#define CT_STUB_TRANSTAB_H
+
+void VG_(discard_translations)(Addr64 start, ULong range, HChar* who);
+
+#endif